@@ -1,974 +1,444 @@
+#include "exchange_engine.h"
+
 #include <iostream>
 #include <string>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
-#include <set>
-#include <iomanip>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <filesystem>
+#include <iterator>
+#include <charconv>
+#include <cstring>
 #include <chrono>
-#include <ctime>
-
-/** 
- * This function retrieves the current date and time with millisecond precision and formats it as a string in the following format: "YYYYMMDD-HHMMSS.SSS".
- * It uses the C++ <chrono> library to obtain the current time, calculates the milliseconds, and formats it into a string representation.
- * The localtime_s function is used on Windows systems for thread-safe time conversion, while localtime_r should be used on POSIX systems.
- * 
- */
-std::string getCurrentTime() {
-
-    auto now = std::chrono::system_clock::now();
-    auto time = std::chrono::system_clock::to_time_t(now);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()) % 1000;
-
-    std::tm timeInfo;
-    localtime_s(&timeInfo, &time); // For Windows. Use localtime_r for POSIX systems.
-
-    std::ostringstream oss;
-    oss << std::put_time(&timeInfo, "%Y/%m/%d-%H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << ms.count();
-
-    return oss.str();
-}
-
-/**
- * This C++ struct, in_ord, represents an order or trade-related data structure with the following fields:
- * 
- * c_ord_id: A string representing the Client Order ID of the submitted order.
- * inst: A string representing the instrument/flower the order.
- * ord_id: A string representing the System generated unique order ID.
- * exec_s: A string representing the execution status or state of the order 0 – New, 1 – Rejected, 2 – Fill, 3 - Pfill.
- * reason: A string that provides a reason or explanation related to the errors occured.
- * side: An integer indicating the order side (e.g., 1 for buy, 2 for sell).
- * qty: An integer representing the total order quantity.
- * exec_qty: An integer representing the quantity of the order that has been executed.
- * price: A double precision floating-point number indicating the price associated with the order.
- * 
- */
-struct in_ord{
-
-std::string c_ord_id,inst,ord_id,exec_s,reason;
-int side, qty, exec_qty;
-double price;
 
+// an order file and the file its execution report is written to. "-" stands for stdin and stdout
+struct Job {
+    std::string input, output;
 };
 
-//  Generates a string for order ID using the number of the current order
-std::string getOrderString(int x) {
-    return "ord" + std::to_string(x);
-}
+// contents of an input file. A file is memory mapped, and stdin is read into memory first
+struct InputFile {
+    std::string stdin_contents;
+    std::unique_ptr<MappedFile> mapped;
+    std::string_view contents;
+
+    bool open(const std::string& path){
+        if (path == "-"){
+            stdin_contents.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+            contents = stdin_contents;
+            return true;
+        }
+        mapped.reset(new MappedFile(path.c_str()));
+        contents = mapped->view();
+        return mapped->is_open();
+    }
+};
 
-// Custom comparison function for ascending order
-bool compareByValueA(const in_ord* a, const in_ord* b) {
-    return a->price < b->price;
-}
+// output file of a job, or stdout for "-"
+struct OutputFile {
+    std::ofstream file;
+    bool to_stdout = false;
 
-// Custom comparison function for descending order
-bool compareByValueD(const in_ord* a, const in_ord* b) {
-    return a->price > b->price;
-}
+    bool open(const std::string& path){
+        to_stdout = path == "-";
+        if (!to_stdout){
+            file.open(path, std::ios::out | std::ios::binary);
+        }
+        return to_stdout || file.is_open();
+    }
+    std::ostream& stream() { return to_stdout ? std::cout : file; }
+};
 
 /**
- * Inserts a pointer to a value of type 'in_ord' into a sorted vector while maintaining the sort order (ascending).
- *
- * This function takes a sorted vector of 'in_ord*' pointers and a new 'in_ord*' pointer 'newValue'.
- * It inserts 'newValue' into the vector in a way that maintains the ascending order of the elements
- * based on the comparison function 'compareByValueA'. If there are elements with the same value as 'newValue',
- * it inserts 'newValue' immediately after the last element with the same value.
- *
+ * Processes the order file of the job, in the CSV or the binary layout, and writes its execution report. The books
+ * start from the state and are saved back into it, and the valid orders are appended to the journal if one is given.
+ * Returns false if a file cannot be opened or read.
  */
-void insertIntoSortedVectorA(std::vector<in_ord*>& sortedVector, in_ord* newValue) {
-
-    if (sortedVector.empty()) {
-        sortedVector.push_back(newValue);
-        return;
+bool processFile(const Job& job, const EngineOptions& options, std::ostream& stats, Snapshot& state, Journal* journal){
+    InputFile input;
+    if (!input.open(job.input)){
+        stats << "Cannot open the order file " << job.input << "\n";
+        return false;
     }
-
-    auto it = std::lower_bound(sortedVector.begin(), sortedVector.end(), newValue, compareByValueA);
-
-    // Find the first element in the vector with the same price
-    auto samePriceIt = it;
-    while (samePriceIt != sortedVector.begin() && compareByValueA(*(samePriceIt - 1), newValue) == false) {
-        --samePriceIt;
+    OutputFile out;
+    if (!out.open(job.output)){
+        stats << "Cannot open the report file " << job.output << "\n";
+        return false;
     }
 
-    // Insert the new value after the last element with the same price
-    sortedVector.insert(samePriceIt, newValue);
+    if (options.ladder_book){
+        return runEngine<LadderOrderBook>(input.contents, out.stream(), options, stats, state, journal);
+    }
+    else{
+        return runEngine<MapOrderBook>(input.contents, out.stream(), options, stats, state, journal);
+    }
 }
 
 /**
- * Inserts a pointer to a value of type 'in_ord' into a sorted vector while maintaining the sort order (descending).
- *
- * This function takes a sorted vector of 'in_ord*' pointers and a new 'in_ord*' pointer 'newValue'.
- * It inserts 'newValue' into the vector in a way that maintains the descending order of the elements
- * based on the comparison function 'compareByValueD'. If there are elements with the same value as 'newValue',
- * it inserts 'newValue' immediately after the last element with the same value.
- *
+ * Rebuilds the books of the state by replaying the orders of the journal file that are not in them yet, discarding
+ * the execution report of the replay. Returns false if the journal cannot be read.
  */
-void insertIntoSortedVectorD(std::vector<in_ord*>& sortedVector, in_ord* newValue) {
-    if (sortedVector.empty()) {
-        sortedVector.push_back(newValue);
-        return;
+bool recoverJournal(const std::string& path, const EngineOptions& options, Snapshot& state, std::ostream& stats){
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file(path.c_str());
+    if (!file.is_open() || !isBinaryFile(file.view(), kJournalMagic)){
+        stats << "Cannot read the journal file " << path << "\n";
+        return false;
     }
-
-    auto it = std::lower_bound(sortedVector.begin(), sortedVector.end(), newValue, compareByValueD);
-
-    // Find the first element in the vector with the same price
-    auto samePriceIt = it;
-    while (samePriceIt != sortedVector.begin() && compareByValueD(*(samePriceIt - 1), newValue) == false) {
-        --samePriceIt;
+    std::ostream discarded(nullptr); // the reports of the replayed orders were written by the run that journaled them
+    std::ostringstream engine_stats;
+    int first_order_no = state.next_order_no;
+    bool replayed = options.ladder_book ? runEngine<LadderOrderBook>(file.view(), discarded, options, engine_stats, state)
+                                        : runEngine<MapOrderBook>(file.view(), discarded, options, engine_stats, state);
+    if (!replayed){
+        stats << engine_stats.str();
+        return false;
     }
-
-    // Insert the new value after the last element with the same price
-    sortedVector.insert(samePriceIt, newValue);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats << "Replayed orders ord" << first_order_no << " to ord" << state.next_order_no - 1 << " of " << path << " in "
+          << ms << " ms, " << state.orders.size() << " resting orders\n";
+    return true;
 }
 
-/// creates in_ord struct using the row in the input order
-/// returns the in_ord struct pointer 
-in_ord* record(std::vector<std::string> row, int order_no){
-    in_ord* order = new in_ord;
-    order->c_ord_id = row[0];
-    order->inst = row[1];
-    order->side = std::stoi(row[2]);
-    order->price = std::stod(row[4]);
-    order->qty = std::stoi(row[3]);
-    order->ord_id = getOrderString(order_no);
-
-    return order;
+/// reads the snapshot file into the state. Returns false if it cannot be opened or is not a snapshot
+bool restoreSnapshot(const std::string& path, Snapshot& state, std::ostream& stats){
+    auto start = std::chrono::steady_clock::now();
+    MappedFile file(path.c_str());
+    size_t dropped = 0;
+    if (!file.is_open() || !readSnapshot(file.view(), state, dropped)){
+        stats << "Cannot read the snapshot file " << path << "\n";
+        return false;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats << "Restored " << state.orders.size() << " resting orders from " << path << " in " << ms
+          << " ms, next order ord" << state.next_order_no << "\n";
+    if (dropped > 0){
+        stats << "Dropped " << dropped << " orders of the snapshot whose instrument is not traded\n";
+    }
+    return true;
 }
 
-/**
- * This function takes an output file stream (`fout`), an `in_ord` structure pointer (`order`), and a `price` value
- * as input and writes the order's information, including its ID, customer ID, instrument, side, execution status,
- * execution quantity, price, reason, and current time, to the provided file stream. Each field is separated by a comma,
- * and a newline character is added at the end of the line.
- *
-*/
-void writeOrderToFile(std::ofstream& fout, const in_ord* order, float price) { //
-    std::string currentTime = getCurrentTime();
-    fout << order->ord_id << ","
-         << order->c_ord_id << ","
-         << order->inst << ","
-         << order->side << ","
-         << order->exec_s << ","
-         << order->exec_qty << ","
-         << price << ","
-         << order->reason << ","
-         << currentTime << "\n";
+/// writes the state to the snapshot file, through a temporary file so that an existing snapshot is replaced at once
+bool saveSnapshot(const std::string& path, const Snapshot& state, std::ostream& stats){
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::binary);
+        writeSnapshot(state, out);
+        if (!out.flush()){
+            stats << "Cannot write the snapshot file " << temporary << "\n";
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error){
+        stats << "Cannot write the snapshot file " << path << "\n";
+        return false;
+    }
+    stats << "Saved " << state.orders.size() << " resting orders to " << path << "\n";
+    return true;
 }
 
 /**
- * checks if the input order is valid
- * if invalid rejects the order and updates the reason
-*/
-bool checkValid(in_ord* order){
-    bool valid = true;
-    std::set<std::string> instruments = {"Rose","Lavender","Lotus","Tulip","Orchid"};
-    auto it = instruments.find(order->inst);
-    if (it == instruments.end()){ // check if the instrument is valid
-        order->reason += "Invalid instrument. "; // update the reason of the order
-        order->exec_s = "Reject"; // update the execution status of the order as Reject
-        order->exec_qty = order->qty; // update the execution quantity of the order
-        valid = false; // update the validity of the order as false
+ * Converts the order file or execution report of the job between the CSV and the binary layouts. The kind of file and
+ * its layout are found from its contents: a binary file is converted to CSV, and a CSV file to binary. A CSV file
+ * whose header starts with "Order ID" is an execution report. Returns false if a file cannot be opened or read.
+ */
+bool convertFile(const Job& job, std::ostream& stats){
+    InputFile input;
+    if (!input.open(job.input)){
+        stats << "Cannot open the file " << job.input << "\n";
+        return false;
     }
-    if (order->side != 1 && order->side != 2){ // check if the side is valid
-        order->reason += "Invalid side. ";
-        order->exec_s = "Reject";
-        order->exec_qty = order->qty;
-        valid = false;
+    OutputFile out;
+    if (!out.open(job.output)){
+        stats << "Cannot open the file " << job.output << "\n";
+        return false;
     }
-    if (order->price <= 0){ // check if the price is valid
-        order->reason += "Invalid price. ";
-        order->exec_s = "Reject";
-        order->exec_qty = order->qty;
-        valid = false;
+
+    std::string_view contents = input.contents;
+    size_t count = 0;
+    const char* kind = "orders";
+    if (isBinaryFile(contents, kBinaryOrderMagic) || isBinaryFile(contents, kBinaryReportMagic)){
+        bool orders = isBinaryFile(contents, kBinaryOrderMagic);
+        bool supported = orders ? binaryRecords(contents, kBinaryOrderMagic, sizeof(BinaryOrder)).data() != nullptr
+                                : binaryRecords(contents, kBinaryReportMagic, sizeof(BinaryReport)).data() != nullptr;
+        if (!supported){
+            stats << "Unsupported binary file " << job.input << "\n";
+            return false;
+        }
+        std::string title = job.output == "-" ? "orders.csv" : std::filesystem::path(job.output).filename().string();
+        count = orders ? convertOrdersToCsv(contents, title, out.stream()) : convertReportToCsv(contents, out.stream());
+        kind = orders ? "orders" : "report rows";
     }
-    if (order->qty % 10 != 0 || order->qty == 0 || order->qty > 1000){ // check if the quantity is valid
-        order->reason += "Invalid size. ";
-        order->exec_s = "Reject";
-        order->exec_qty = order->qty;
-        valid = false;
+    else{
+        size_t header = contents.find('\n') + 1; // start of the header column names, or 0 without a newline
+        if (contents.substr(header, 8) == "Order ID"){
+            count = convertReportToBinary(contents, out.stream());
+            kind = "report rows";
+        }
+        else{
+            count = convertOrdersToBinary(contents, out.stream());
+        }
     }
-    return valid;
-
+    out.stream().flush();
+    stats << "Converted " << count << " " << kind << "\n";
+    return true;
 }
 
-int main(){
-    //order books initialization
-    std::vector<in_ord*> 
-    blue_list_rose, pink_list_rose,
-    blue_list_lavender, pink_list_lavender,
-    blue_list_lotus, pink_list_lotus,
-    blue_list_tulip, pink_list_tulip,
-    blue_list_orchid, pink_list_orchid;
-
-    // file pointer for execution report
-    std::ofstream fout;
-
-     // opens an existing csv file or creates a new file.
-    fout.open("execution_rep.csv", std::ios::out);
+/// reads a positive number from the text of a command line option
+bool parseCount(const char* text, size_t& value){
+    const char* end = text + std::strlen(text);
+    auto result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end && value > 0;
+}
 
-    // Creation of ifstream class object to read the file
-    std::ifstream fin;
+/// reads a number, which may be 0, from the text of a command line option
+bool parseLimit(const char* text, size_t& value){
+    const char* end = text + std::strlen(text);
+    auto result = std::from_chars(text, end, value);
+    return result.ec == std::errc() && result.ptr == end;
+}
 
-    // order file. Change the file name to test with different order files
-    fin.open("orders11.csv");
+void printUsage(std::ostream& out){
+    out << "Usage: exchange_app [options] [order files or directories...]\n"
+           "\n"
+           "Reads the order files (every .csv and .bin file of a directory, or stdin if none or \"-\" is given) and\n"
+           "writes an execution report for each of them. Several files are processed in parallel, each by its own\n"
+           "engine. Order files are read in the CSV layout or in the binary layout written by --convert.\n"
+           "\n"
+           "Options:\n"
+           "  -o, --output PATH     report file, or directory of the reports (default execution_rep.csv for a single\n"
+           "                        order file and the current directory for several). \"-\" writes to stdout\n"
+           "  --mode MODE           single, sharded or pipeline (default single)\n"
+           "  --book BOOK           map or ladder (default map)\n"
+           "  --shards N            matching threads of the sharded mode (default one per instrument)\n"
+           "  --queue-size N        capacity of the queues between threads (default 4096)\n"
+           "  --buffer-size BYTES   report writer buffer size (default 1048576)\n"
+           "  --report-format F     csv or binary (default csv)\n"
+           "  --convert             convert the files between the CSV and binary layouts instead of matching them.\n"
+           "                        Order files and execution reports are both converted, and the layout is found\n"
+           "                        from the contents. The output defaults to the input name with .bin or .csv\n"
+           "  --restore FILE        start from the books of a snapshot file\n"
+           "  --snapshot FILE       save the books to a snapshot file at the end\n"
+           "                        With --restore or --snapshot the order files are processed one after another,\n"
+           "                        each starting from the books left by the previous one\n"
+           "  --journal FILE        append every valid order to a write-ahead journal before matching it. Report rows\n"
+           "                        reach their file only after the orders they come from reach the journal\n"
+           "  --sync-orders N       sync the journal once N orders wait for it (default no limit)\n"
+           "  --sync-micros N       sync the journal once the oldest waiting order has waited N microseconds\n"
+           "                        (default 1000). With --sync-orders 0 --sync-micros 0 it is never synced\n"
+           "  --recover FILE        rebuild the books by replaying a journal, after --restore if given, and\n"
+           "                        continue from them. With --journal, --recover or --restore / --snapshot the\n"
+           "                        order files are processed one after another\n"
+           "  -j, --jobs N          order files processed in parallel (default number of cores)\n"
+           "  -h, --help            show this help\n";
+}
 
-    // Execute a loop until EOF (End of File)
-    int line_no = 1;
-    int order_no = 1;
-    std::string line, word;
-    std::vector<std::string> row;
-    while (std::getline(fin, line)) {
-        
-        if (line_no < 3){ //skip first two lines which contains the name and header column name of the csv file
-            line_no += 1;
-            if (line_no ==2){
-                fout << "execution_rep.csv" << "," << "," << "," << "," << "," << "\n" // write the name of the output file
-                << "Order ID" << ","            // write the header column names
-                << "Client Order ID" << ","
-                << "Instrument" << ","
-                << "Side" << ","
-                << "Exec Status" << ","
-                << "Quantity" << ","
-                << "Price" << ","
-                << "Reason" << ","
-                << "Transaction time" << "\n";
-            }
+int main(int argc, char* argv[]){
+    EngineOptions options;
+    std::vector<std::string> inputs;
+    std::string output;
+    size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool convert = false;
+    std::string restore_file, snapshot_file;
+    std::string journal_file, recover_file;
+    JournalOptions journal_options;
+
+    // read the command line
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        size_t count = 0;
+        bool ok = true;
+        if (arg == "-h" || arg == "--help"){
+            printUsage(std::cout);
+            return 0;
+        }
+        else if ((arg == "-o" || arg == "--output") && value){
+            output = value;
+        }
+        else if (arg == "--mode" && value){
+            std::string mode = value;
+            ok = mode == "single" || mode == "sharded" || mode == "pipeline";
+            options.mode = mode == "sharded" ? EngineOptions::kSharded : mode == "pipeline" ? EngineOptions::kPipeline : EngineOptions::kSingle;
+        }
+        else if (arg == "--book" && value){
+            std::string book = value;
+            ok = book == "map" || book == "ladder";
+            options.ladder_book = book == "ladder";
+        }
+        else if (arg == "--shards" && value){
+            ok = parseCount(value, count);
+            options.shards = (int)count;
+        }
+        else if (arg == "--queue-size" && value){
+            ok = parseCount(value, options.queue_size);
+        }
+        else if (arg == "--buffer-size" && value){
+            ok = parseCount(value, options.buffer_size);
+        }
+        else if (arg == "--report-format" && value){
+            std::string format = value;
+            ok = format == "csv" || format == "binary";
+            options.report_format = format == "binary" ? ReportFormat::Binary : ReportFormat::Csv;
+        }
+        else if (arg == "--restore" && value){
+            restore_file = value;
+        }
+        else if (arg == "--snapshot" && value){
+            snapshot_file = value;
+        }
+        else if (arg == "--journal" && value){
+            journal_file = value;
+        }
+        else if (arg == "--sync-orders" && value){
+            ok = parseLimit(value, journal_options.sync_orders);
+        }
+        else if (arg == "--sync-micros" && value){
+            ok = parseLimit(value, count);
+            journal_options.sync_micros = (long long)count;
+        }
+        else if (arg == "--recover" && value){
+            recover_file = value;
+        }
+        else if (arg == "--convert"){
+            convert = true;
+            continue; // the option has no value
+        }
+        else if ((arg == "-j" || arg == "--jobs") && value){
+            ok = parseCount(value, jobs);
+        }
+        else if (arg == "-" || arg[0] != '-'){
+            inputs.push_back(arg);
             continue;
         }
-
-        row.clear(); // clear the vector if it is not empty
-
-        // used for breaking words
-        std::stringstream s(line);
-
-        // read every column data of a row and
-        // store it in a string variable, 'word'
-        while (std::getline(s, word, ',')) {
-  
-            // add all the column data
-            // of a row to a vector
-            row.push_back(word);
+        else{
+            ok = false;
         }
-
-        
-        in_ord* order = record(row, order_no); // create the order struct using the row in the input order
-        order_no += 1; // increment the order number
-
-        // check if the order is valid
-        if (!checkValid(order)){
-            writeOrderToFile(fout, order, order->price);
-        }
-        // if valid, execute the order
-        else if (order->inst == "Rose"){
-            switch (order->side){
-                case 1: // buy order
-                if (!pink_list_rose.empty()){ // do the following if there is a sell order in the pink list
-                    if (order->price >= pink_list_rose.back()->price){ // do the following if the price of the buy order is greater than or equal to the price of the sell order in the pink list
-                        insertIntoSortedVectorA(blue_list_rose, order); // insert the order into the blue list
-                        while (order->qty > 0 && !pink_list_rose.empty() && order->price >= pink_list_rose.back()->price){ // do while the quantity of the buy order becomes zero.
-                            if (order->qty == pink_list_rose.back()->qty){ // do the following if the quantity of the buy order is equal to the quantity of the sell order in the pink list
-                                order->exec_s = "Fill"; // update the execution status of the buy order ass Fill
-                                order->exec_qty = order->qty; // update the execution quantity of the buy order
-                                writeOrderToFile(fout, order, pink_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the sell order in the pink list since the input order is a buy order
-                                
-
-                                pink_list_rose.back()->exec_s = "Fill"; // do the same for the sell order in the pink list
-                                pink_list_rose.back()->exec_qty = pink_list_rose.back()->qty; 
-                                writeOrderToFile(fout, pink_list_rose.back(), pink_list_rose.back()->price); 
-
-                                delete pink_list_rose.back(); // release the sell order memory for the pointer in the back of pink list since it is filled
-                                pink_list_rose.pop_back(); // remove the sell order pointer from the pink list
-                                delete blue_list_rose.back(); // do the same for buy order list
-                                blue_list_rose.pop_back();
-                            }
-                            else if(order->qty > pink_list_rose.back()->qty){ // do the following if the quantity of the buy order is greater than the quantity of the sell order in the pink list
-                                order->exec_s = "Pfill"; // update the execution status of the buy order as Pfill
-                                order->exec_qty = pink_list_rose.back()->qty; // update the execution quantity of the buy order
-                                order->qty -= order->exec_qty; // update the quantity of the buy order
-                                writeOrderToFile(fout, order, pink_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the sell order in the pink list since the input order is a buy order
-
-                                pink_list_rose.back()->exec_s = "Fill"; // do the same for the sell order in the pink list
-                                pink_list_rose.back()->exec_qty = pink_list_rose.back()->qty;
-                                writeOrderToFile(fout, pink_list_rose.back(), pink_list_rose.back()->price);
-
-                                delete pink_list_rose.back(); // release the sell order memory for the pointer in the back of pink list since it is filled
-                                pink_list_rose.pop_back();
-                                // Here we do not delete the buy order pointer since it is not filled yet
-                            }
-                            else{ // do the following if the quantity of the buy order is less than the quantity of the sell order in the pink list
-                                order->exec_s = "Fill"; // update the execution status of the buy order as Fill
-                                order->exec_qty = order->qty; // update the execution quantity of the buy order
-                                order->qty -= order->exec_qty; // update the quantity of the buy order
-                                writeOrderToFile(fout, order, pink_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the sell order in the pink list since the input order is a buy order
-                                
-                                pink_list_rose.back()->exec_s = "Pfill"; // update the execution status of the sell order in the pink list as Pfill
-                                pink_list_rose.back()->exec_qty = order->exec_qty; // update the execution quantity of the sell order
-                                pink_list_rose.back()->qty -= pink_list_rose.back()->exec_qty; // update the quantity of the sell order
-                                writeOrderToFile(fout, pink_list_rose.back(), pink_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the sell order in the pink list since the input order is a buy order
-
-                                delete blue_list_rose.back(); // release the buy order memory for the pointer in the back of blue list since it is filled
-                                blue_list_rose.pop_back();
-                                // Here we do not delete the sell order pointer since it is not filled yet
-                            }
-                        }
-                        
-                    }
-                    else{ // do the following if the price of the buy order is less than the price of the sell order in the pink list. This means it is should be a new order.
-                        order->exec_s = "New"; // update the execution status of the buy order as New
-                        order->exec_qty = order->qty; // update the execution quantity of the buy order
-                        order->reason = ""; // update the reason of the buy order as empty
-                        writeOrderToFile(fout, order, order->price); // write the order to the execution report. Important thing is to use the price of the buy order since the input order is a buy order
-                        insertIntoSortedVectorA(blue_list_rose, order); // insert the order into the blue list
-                    }
-                }
-                else{ // do the following if there is no sell order in the pink list. This means it is should be a new order.
-                    order->exec_s = "New"; // update the execution status of the buy order as New
-                    order->exec_qty = order->qty; // update the execution quantity of the buy order
-                    order->reason = ""; // update the reason of the buy order as empty
-                    writeOrderToFile(fout, order, order->price); // write the order to the execution report. Important thing is to use the price of the buy order since the input order is a buy order
-                    insertIntoSortedVectorA(blue_list_rose, order); // insert the order into the blue list
-                }
-                break; // end of buy order
-
-                case 2: // sell order
-                if (!blue_list_rose.empty()){ // do the following if there is a buy order in the blue list
-                    if (order->price <= blue_list_rose.back()->price){ // do the following if the price of the sell order is less than or equal to the price of the buy order in the blue list
-                        insertIntoSortedVectorD(pink_list_rose, order); // insert the order into the pink list
-                        while (order->qty > 0 && !blue_list_rose.empty() && order->price <= blue_list_rose.back()->price){ // do while the quantity of the sell order becomes zero.
-                            if (order->qty == blue_list_rose.back()->qty){ // do the following if the quantity of the sell order is equal to the quantity of the buy order in the blue list
-                                order->exec_s = "Fill"; // update the execution status of the buy order as Fill 
-                                order->exec_qty = order->qty; // update the execution quantity of the buy order
-                                writeOrderToFile(fout, order, blue_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the buy order in the blue list since the input order is a sell order
-                                
-
-                                blue_list_rose.back()->exec_s = "Fill"; // do the same for the buy order in the blue list
-                                blue_list_rose.back()->exec_qty = blue_list_rose.back()->qty;
-                                writeOrderToFile(fout, blue_list_rose.back(), blue_list_rose.back()->price);
-
-                                delete blue_list_rose.back(); // release the buy order memory for the pointer in the back of blue list since it is filled
-                                blue_list_rose.pop_back(); // remove the buy order pointer from the blue list
-                                delete pink_list_rose.back(); // do the same for sell order list
-                                pink_list_rose.pop_back();
-                            }
-                            else if(order->qty > blue_list_rose.back()->qty){ // do the following if the quantity of the sell order is greater than the quantity of the buy order in the blue list
-                                order->exec_s = "Pfill"; // update the execution status of the buy order as Pfill
-                                order->exec_qty = blue_list_rose.back()->qty; // update the execution quantity of the buy order
-                                order->qty -= order->exec_qty; // update the quantity of the buy order
-                                writeOrderToFile(fout, order, blue_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the buy order in the blue list since the input order is a sell order
-
-                                blue_list_rose.back()->exec_s = "Fill"; // do the same for the buy order in the blue list
-                                blue_list_rose.back()->exec_qty = blue_list_rose.back()->qty; // update the execution quantity of the buy order
-                                writeOrderToFile(fout, blue_list_rose.back(), blue_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the buy order in the blue list since the input order is a sell order
-
-                                delete blue_list_rose.back(); // release the buy order memory for the pointer in the back of blue list since it is filled
-                                blue_list_rose.pop_back(); // remove the buy order pointer from the blue list
-                                // Here we do not delete the sell order pointer since it is not filled yet
-                            }
-                            else{ // do the following if the quantity of the sell order is less than the quantity of the buy order in the blue list
-                                order->exec_s = "Fill"; // update the execution status of the buy order as Fill
-                                order->exec_qty = order->qty; // update the execution quantity of the buy order
-                                order->qty -= order->exec_qty; // update the quantity of the buy order
-                                writeOrderToFile(fout, order, blue_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the buy order in the blue list since the input order is a sell order
-
-                                blue_list_rose.back()->exec_s = "Pfill"; // update the execution status of the buy order as Pfill
-                                blue_list_rose.back()->exec_qty = order->exec_qty; // update the execution quantity of the buy order
-                                blue_list_rose.back()->qty -= blue_list_rose.back()->exec_qty; // update the quantity of the buy order
-                                writeOrderToFile(fout, blue_list_rose.back(), blue_list_rose.back()->price); // write the order to the execution report. Important thing is to use the price of the buy order in the blue list since the input order is a sell order
-
-                                delete pink_list_rose.back(); // release the sell order memory for the pointer in the back of pink list since it is filled
-                                pink_list_rose.pop_back(); // remove the sell order pointer from the pink list
-                                // Here we do not delete the buy order pointer since it is not filled yet
-                            }
-                        }
-                        
-                    }
-                    else{ // do the following if the price of the sell order is greater than the price of the buy order in the blue list. This means it is should be a new order.
-                        order->exec_s = "New"; // update the execution status of the buy order as New
-                        order->exec_qty = order->qty; // update the execution quantity of the buy order
-                        order->reason = ""; // update the reason of the buy order as empty
-                        writeOrderToFile(fout, order, order->price); // write the order to the execution report. Important thing is to use the price of the sell order since the input order is a sell order
-                        insertIntoSortedVectorD(pink_list_rose, order); // insert the order into the pink list
-                    }
-                }
-                else{ // do the following if there is no buy order in the blue list. This means it is should be a new order.
-                    order->exec_s = "New"; // update the execution status of the buy order as New
-                    order->exec_qty = order->qty; // update the execution quantity of the buy order
-                    order->reason = ""; // update the reason of the buy order as empty
-                    writeOrderToFile(fout, order, order->price); // write the order to the execution report. Important thing is to use the price of the sell order since the input order is a sell order
-                    insertIntoSortedVectorD(pink_list_rose, order); // insert the order into the pink list
-                }
-                break;
-            }
-
+        if (!ok){
+            std::cerr << "Invalid option " << arg << (value ? std::string(" ") + value : std::string()) << "\n\n";
+            printUsage(std::cerr);
+            return 2;
         }
-        else if (order->inst == "Lavender"){ // do the same for Lavender
-            switch (order->side){
-                case 1:
-                if (!pink_list_lavender.empty()){
-                    if (order->price >= pink_list_lavender.back()->price){
-                        insertIntoSortedVectorA(blue_list_lavender, order);
-                        while (order->qty > 0 && !pink_list_lavender.empty() && order->price >= pink_list_lavender.back()->price){
-                            if (order->qty == pink_list_lavender.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, pink_list_lavender.back()->price);
-                                
-
-                                pink_list_lavender.back()->exec_s = "Fill";
-                                pink_list_lavender.back()->exec_qty = pink_list_lavender.back()->qty;
-                                writeOrderToFile(fout, pink_list_lavender.back(), pink_list_lavender.back()->price);
-
-                                delete pink_list_lavender.back();
-                                pink_list_lavender.pop_back();
-                                delete blue_list_lavender.back();
-                                blue_list_lavender.pop_back();
-                            }
-                            else if(order->qty > pink_list_lavender.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = pink_list_lavender.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_lavender.back()->price);
-
-                                pink_list_lavender.back()->exec_s = "Fill";
-                                pink_list_lavender.back()->exec_qty = pink_list_lavender.back()->qty;
-                                writeOrderToFile(fout, pink_list_lavender.back(), pink_list_lavender.back()->price);
-
-                                delete pink_list_lavender.back();
-                                pink_list_lavender.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_lavender.back()->price);
-                                
-
-                                pink_list_lavender.back()->exec_s = "Pfill";
-                                pink_list_lavender.back()->exec_qty = order->exec_qty;
-                                pink_list_lavender.back()->qty -= pink_list_lavender.back()->exec_qty;
-                                writeOrderToFile(fout, pink_list_lavender.back(), pink_list_lavender.back()->price);
-
-                                delete blue_list_lavender.back();
-                                blue_list_lavender.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorA(blue_list_lavender, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorA(blue_list_lavender, order);
-                }
-                break;
-
-                case 2:
-                if (!blue_list_lavender.empty()){
-                    if (order->price <= blue_list_lavender.back()->price){
-                        insertIntoSortedVectorD(pink_list_lavender, order);
-                        while (order->qty > 0 && !blue_list_lavender.empty() && order->price <= blue_list_lavender.back()->price){
-                            if (order->qty == blue_list_lavender.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, blue_list_lavender.back()->price);
-                                
-
-                                blue_list_lavender.back()->exec_s = "Fill";
-                                blue_list_lavender.back()->exec_qty = blue_list_lavender.back()->qty;
-                                writeOrderToFile(fout, blue_list_lavender.back(), blue_list_lavender.back()->price);
-
-                                delete blue_list_lavender.back();
-                                blue_list_lavender.pop_back();
-                                delete pink_list_lavender.back();
-                                pink_list_lavender.pop_back();
-                            }
-                            else if(order->qty > blue_list_lavender.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = blue_list_lavender.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_lavender.back()->price);
-
-                                blue_list_lavender.back()->exec_s = "Fill";
-                                blue_list_lavender.back()->exec_qty = blue_list_lavender.back()->qty;
-                                writeOrderToFile(fout, blue_list_lavender.back(), blue_list_lavender.back()->price);
-
-                                delete blue_list_lavender.back();
-                                blue_list_lavender.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_lavender.back()->price);
-
-                                blue_list_lavender.back()->exec_s = "Pfill";
-                                blue_list_lavender.back()->exec_qty = order->exec_qty;
-                                blue_list_lavender.back()->qty -= blue_list_lavender.back()->exec_qty;
-                                writeOrderToFile(fout, blue_list_lavender.back(), blue_list_lavender.back()->price);
+        i++; // skip the value of the option
+    }
 
-                                 delete pink_list_lavender.back();
-                                pink_list_lavender.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorD(pink_list_lavender, order);
-                    }
+    // expand the directories into their order files
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for (const std::string& input : inputs){
+        std::error_code error;
+        if (input != "-" && fs::is_directory(input, error)){
+            std::vector<std::string> order_files;
+            for (const fs::directory_entry& entry : fs::directory_iterator(input, error)){
+                if (entry.is_regular_file(error) && (entry.path().extension() == ".csv" || entry.path().extension() == ".bin")){
+                    order_files.push_back(entry.path().string());
                 }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorD(pink_list_lavender, order);
-                }
-                break;
             }
-
+            std::sort(order_files.begin(), order_files.end());
+            files.insert(files.end(), order_files.begin(), order_files.end());
         }
-        else if (order->inst == "Lotus"){ // do the same for Lotus
-            switch (order->side){
-                case 1:
-                if (!pink_list_lotus.empty()){
-                    if (order->price >= pink_list_lotus.back()->price){
-                        insertIntoSortedVectorA(blue_list_lotus, order);
-                        while (order->qty > 0 && !pink_list_lotus.empty() && order->price >= pink_list_lotus.back()->price){
-                            if (order->qty == pink_list_lotus.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, pink_list_lotus.back()->price);
-                                
-
-                                pink_list_lotus.back()->exec_s = "Fill";
-                                pink_list_lotus.back()->exec_qty = pink_list_lotus.back()->qty;
-                                writeOrderToFile(fout, pink_list_lotus.back(), pink_list_lotus.back()->price);
-
-                                delete pink_list_lotus.back();
-                                pink_list_lotus.pop_back();
-                                delete blue_list_lotus.back();
-                                blue_list_lotus.pop_back();
-                            }
-                            else if(order->qty > pink_list_lotus.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = pink_list_lotus.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_lotus.back()->price);
-
-                                pink_list_lotus.back()->exec_s = "Fill";
-                                pink_list_lotus.back()->exec_qty = pink_list_lotus.back()->qty;
-                                writeOrderToFile(fout, pink_list_lotus.back(), pink_list_lotus.back()->price);
-
-                                delete pink_list_lotus.back();
-                                pink_list_lotus.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_lotus.back()->price);
-                                
-
-                                pink_list_lotus.back()->exec_s = "Pfill";
-                                pink_list_lotus.back()->exec_qty = order->exec_qty;
-                                pink_list_lotus.back()->qty -= pink_list_lotus.back()->exec_qty;
-                                writeOrderToFile(fout, pink_list_lotus.back(), pink_list_lotus.back()->price);
-
-                                delete blue_list_lotus.back();
-                                blue_list_lotus.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorA(blue_list_lotus, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorA(blue_list_lotus, order);
-                }
-                break;
-
-                case 2:
-                if (!blue_list_lotus.empty()){
-                    if (order->price <= blue_list_lotus.back()->price){
-                        insertIntoSortedVectorD(pink_list_lotus, order);
-                        while (order->qty > 0 && !blue_list_lotus.empty() && order->price <= blue_list_lotus.back()->price){
-                            if (order->qty == blue_list_lotus.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, blue_list_lotus.back()->price);
-                                
-
-                                blue_list_lotus.back()->exec_s = "Fill";
-                                blue_list_lotus.back()->exec_qty = blue_list_lotus.back()->qty;
-                                writeOrderToFile(fout, blue_list_lotus.back(), blue_list_lotus.back()->price);
-                                
-                                delete blue_list_lotus.back();
-                                blue_list_lotus.pop_back();
-                                delete pink_list_lotus.back();
-                                pink_list_lotus.pop_back();
-                            }
-                            else if(order->qty > blue_list_lotus.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = blue_list_lotus.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_lotus.back()->price);
-
-                                blue_list_lotus.back()->exec_s = "Fill";
-                                blue_list_lotus.back()->exec_qty = blue_list_lotus.back()->qty;
-                                writeOrderToFile(fout, blue_list_lotus.back(), blue_list_lotus.back()->price);
-
-                                delete blue_list_lotus.back();
-                                blue_list_lotus.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_lotus.back()->price);
-                                
-
-                                blue_list_lotus.back()->exec_s = "Pfill";
-                                blue_list_lotus.back()->exec_qty = order->exec_qty;
-                                blue_list_lotus.back()->qty -= blue_list_lotus.back()->exec_qty;
-                                writeOrderToFile(fout, blue_list_lotus.back(), blue_list_lotus.back()->price);
-
-                                delete pink_list_lotus.back();
-                                pink_list_lotus.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorD(pink_list_lotus, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorD(pink_list_lotus, order);
-                }
-                break;
-            }
-
+        else{
+            files.push_back(input);
         }
-        else if (order->inst == "Tulip"){ // do the same for Tulip
-            switch (order->side){
-                case 1:
-                if (!pink_list_tulip.empty()){
-                    if (order->price >= pink_list_tulip.back()->price){
-                        insertIntoSortedVectorA(blue_list_tulip, order);
-                        while (order->qty > 0 && !pink_list_tulip.empty() && order->price >= pink_list_tulip.back()->price){
-                            if (order->qty == pink_list_tulip.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, pink_list_tulip.back()->price);
-                                
-
-                                pink_list_tulip.back()->exec_s = "Fill";
-                                pink_list_tulip.back()->exec_qty = pink_list_tulip.back()->qty;
-                                writeOrderToFile(fout, pink_list_tulip.back(), pink_list_tulip.back()->price);
-
-                                delete pink_list_tulip.back();
-                                pink_list_tulip.pop_back();
-                                delete blue_list_tulip.back();
-                                blue_list_tulip.pop_back();
-                            }
-                            else if(order->qty > pink_list_tulip.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = pink_list_tulip.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_tulip.back()->price);
-
-                                pink_list_tulip.back()->exec_s = "Fill";
-                                pink_list_tulip.back()->exec_qty = pink_list_tulip.back()->qty;
-                                writeOrderToFile(fout, pink_list_tulip.back(), pink_list_tulip.back()->price);
-
-                                delete pink_list_tulip.back();
-                                pink_list_tulip.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_tulip.back()->price);
-                                
-
-                                pink_list_tulip.back()->exec_s = "Pfill";
-                                pink_list_tulip.back()->exec_qty = order->exec_qty;
-                                pink_list_tulip.back()->qty -= pink_list_tulip.back()->exec_qty;
-                                writeOrderToFile(fout, pink_list_tulip.back(), pink_list_tulip.back()->price);
-
-                                delete blue_list_tulip.back();
-                                blue_list_tulip.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorA(blue_list_tulip, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorA(blue_list_tulip, order);
-                }
-                break;
-
-                case 2:
-                if (!blue_list_tulip.empty()){
-                    if (order->price <= blue_list_tulip.back()->price){
-                        insertIntoSortedVectorD(pink_list_tulip, order);
-                        while (order->qty > 0 && !blue_list_tulip.empty() && order->price <= blue_list_tulip.back()->price){
-                            if (order->qty == blue_list_tulip.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, blue_list_tulip.back()->price);
-                                
-
-                                blue_list_tulip.back()->exec_s = "Fill";
-                                blue_list_tulip.back()->exec_qty = blue_list_tulip.back()->qty;
-                                writeOrderToFile(fout, blue_list_tulip.back(), blue_list_tulip.back()->price);
-
-                                delete blue_list_tulip.back();
-                                blue_list_tulip.pop_back();
-                                delete pink_list_tulip.back();
-                                pink_list_tulip.pop_back();
-                            }
-                            else if(order->qty > blue_list_tulip.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = blue_list_tulip.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_tulip.back()->price);
-
-                                blue_list_tulip.back()->exec_s = "Fill";
-                                blue_list_tulip.back()->exec_qty = blue_list_tulip.back()->qty;
-                                writeOrderToFile(fout, blue_list_tulip.back(), blue_list_tulip.back()->price);
-
-                                delete blue_list_tulip.back();
-                                blue_list_tulip.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_tulip.back()->price);
-                                
-
-                                blue_list_tulip.back()->exec_s = "Pfill";
-                                blue_list_tulip.back()->exec_qty = order->exec_qty;
-                                blue_list_tulip.back()->qty -= blue_list_tulip.back()->exec_qty;
-                                writeOrderToFile(fout, blue_list_tulip.back(), blue_list_tulip.back()->price);
-
-                                delete pink_list_tulip.back();
-                                pink_list_tulip.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorD(pink_list_tulip, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorD(pink_list_tulip, order);
-                }
-                break;
-            }
+    }
+    if (inputs.empty()){
+        files.push_back("-");
+    }
 
+    // pick the report file of every order file: the output itself for a single order file, otherwise
+    // <name>_execution_rep.csv (or .bin) in the output directory. Converted files keep their name with the other
+    // extension
+    std::error_code error;
+    const char* report_extension = options.report_format == ReportFormat::Binary ? ".bin" : ".csv";
+    bool output_is_directory = files.size() > 1 || (!output.empty() && output != "-" && fs::is_directory(output, error))
+                               || (convert && output.empty());
+    if (files.size() > 1 && output == "-"){
+        std::cerr << "Several order files cannot be written to stdout\n";
+        return 2;
+    }
+    std::vector<Job> work;
+    for (const std::string& file : files){
+        if (!output_is_directory){
+            work.push_back({file, output.empty() ? std::string("execution_rep") + report_extension : output});
+            continue;
         }
-        else{ // do the same for Orchid
-            switch (order->side){
-                case 1:
-                if (!pink_list_orchid.empty()){
-                    if (order->price >= pink_list_orchid.back()->price){
-                        insertIntoSortedVectorA(blue_list_orchid, order);
-                        while (order->qty > 0 && !pink_list_orchid.empty() && order->price >= pink_list_orchid.back()->price){
-                            if (order->qty == pink_list_orchid.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, pink_list_orchid.back()->price);
-                                
-
-                                pink_list_orchid.back()->exec_s = "Fill";
-                                pink_list_orchid.back()->exec_qty = pink_list_orchid.back()->qty;
-                                writeOrderToFile(fout, pink_list_orchid.back(), pink_list_orchid.back()->price);
-
-                                delete pink_list_orchid.back();
-                                pink_list_orchid.pop_back();
-                                delete blue_list_orchid.back();
-                                blue_list_orchid.pop_back();
-                            }
-                            else if(order->qty > pink_list_orchid.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = pink_list_orchid.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_orchid.back()->price);
-
-                                pink_list_orchid.back()->exec_s = "Fill";
-                                pink_list_orchid.back()->exec_qty = pink_list_orchid.back()->qty;
-                                writeOrderToFile(fout, pink_list_orchid.back(), pink_list_orchid.back()->price);
-
-                                delete pink_list_orchid.back();
-                                pink_list_orchid.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, pink_list_orchid.back()->price);
-                                
-
-                                pink_list_orchid.back()->exec_s = "Pfill";
-                                pink_list_orchid.back()->exec_qty = order->exec_qty;
-                                pink_list_orchid.back()->qty -= pink_list_orchid.back()->exec_qty;
-                                writeOrderToFile(fout, pink_list_orchid.back(), pink_list_orchid.back()->price);
-
-                                delete blue_list_orchid.back();
-                                blue_list_orchid.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorA(blue_list_orchid, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorA(blue_list_orchid, order);
-                }
-                break;
-
-                case 2:
-                if (!blue_list_orchid.empty()){
-                    if (order->price <= blue_list_orchid.back()->price){
-                        insertIntoSortedVectorD(pink_list_orchid, order);
-                        while (order->qty > 0 && !blue_list_orchid.empty() && order->price <= blue_list_orchid.back()->price){
-                            if (order->qty == blue_list_orchid.back()->qty){
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                writeOrderToFile(fout, order, blue_list_orchid.back()->price);
-                                
-
-                                blue_list_orchid.back()->exec_s = "Fill";
-                                blue_list_orchid.back()->exec_qty = blue_list_orchid.back()->qty;
-                                writeOrderToFile(fout, blue_list_orchid.back(), blue_list_orchid.back()->price);
-
-                                delete blue_list_orchid.back();
-                                blue_list_orchid.pop_back();
-                                delete pink_list_orchid.back();
-                                pink_list_orchid.pop_back();
-                            }
-                            else if(order->qty > blue_list_orchid.back()->qty){
-                                order->exec_s = "Pfill";
-                                order->exec_qty = blue_list_orchid.back()->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_orchid.back()->price);
-
-                                blue_list_orchid.back()->exec_s = "Fill";
-                                blue_list_orchid.back()->exec_qty = blue_list_orchid.back()->qty;
-                                writeOrderToFile(fout, blue_list_orchid.back(), blue_list_orchid.back()->price);
-
-                                delete blue_list_orchid.back();
-                                blue_list_orchid.pop_back();
-                            }
-                            else{
-                                order->exec_s = "Fill";
-                                order->exec_qty = order->qty;
-                                order->qty -= order->exec_qty;
-                                writeOrderToFile(fout, order, blue_list_orchid.back()->price);
-                                
+        fs::path directory = output.empty() ? fs::path(".") : fs::path(output);
+        fs::create_directories(directory, error);
+        std::string name = file == "-" ? "stdin" : fs::path(file).stem().string();
+        if (convert){
+            name += fs::path(file).extension() == ".bin" ? ".csv" : ".bin";
+        }
+        else{
+            name += std::string("_execution_rep") + report_extension;
+        }
+        work.push_back({file, (directory / name).string()});
+    }
 
-                                blue_list_orchid.back()->exec_s = "Pfill";
-                                blue_list_orchid.back()->exec_qty = order->exec_qty;
-                                blue_list_orchid.back()->qty -= blue_list_orchid.back()->exec_qty;
-                                writeOrderToFile(fout, blue_list_orchid.back(), blue_list_orchid.back()->price);
+    // the books carried from file to file, starting from the snapshot to restore and the journal to replay. The
+    // orders of a journal must be matched in the order they are journaled, so journaling also carries the books
+    bool carry_books = !convert && (!restore_file.empty() || !snapshot_file.empty() || !journal_file.empty() || !recover_file.empty());
+    Snapshot carried;
+    if (carry_books){
+        jobs = 1; // each file starts from the books of the previous one
+        if (!restore_file.empty() && !restoreSnapshot(restore_file, carried, std::cerr)){
+            return 1;
+        }
+        if (!recover_file.empty() && !recoverJournal(recover_file, options, carried, std::cerr)){
+            return 1;
+        }
+    }
+    std::unique_ptr<Journal> journal;
+    if (!convert && !journal_file.empty()){
+        journal.reset(new Journal(journal_file, journal_options));
+        if (!journal->is_open()){
+            std::cerr << "Cannot open the journal file " << journal_file << "\n";
+            return 1;
+        }
+    }
 
-                                delete pink_list_orchid.back();
-                                pink_list_orchid.pop_back();
-                            }
-                        }
-                        
-                    }
-                    else{
-                        order->exec_s = "New";
-                        order->exec_qty = order->qty;
-                        order->reason = "";
-                        writeOrderToFile(fout, order, order->price);
-                        insertIntoSortedVectorD(pink_list_orchid, order);
-                    }
-                }
-                else{
-                    order->exec_s = "New";
-                    order->exec_qty = order->qty;
-                    order->reason = "";
-                    writeOrderToFile(fout, order, order->price);
-                    insertIntoSortedVectorD(pink_list_orchid, order);
-                }
-                break;
+    // process the files on a pool of worker threads, each file by its own engine
+    std::atomic<size_t> next_job{0};
+    std::atomic<bool> failed{false};
+    std::mutex stats_mutex;
+    auto worker = [&](){
+        for (size_t i = next_job++; i < work.size(); i = next_job++){
+            std::ostringstream stats;
+            Snapshot empty_books;
+            Snapshot& state = carry_books ? carried : empty_books;
+            if (!(convert ? convertFile(work[i], stats) : processFile(work[i], options, stats, state, journal.get()))){
+                failed = true;
             }
-
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            if (work.size() > 1){
+                std::cerr << work[i].input << " -> " << work[i].output << "\n";
+            }
+            std::cerr << stats.str();
         }
-        line_no += 1;
-
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(jobs, work.size()); i++){
+        workers.emplace_back(worker);
+    }
+    worker(); // the main thread is one of the workers
+    for (std::thread& thread : workers){
+        thread.join();
     }
 
-    fin.close();
-
+    if (journal){
+        journal->commit();
+        journal->printStats(std::cerr);
+    }
+    if (!snapshot_file.empty() && !convert && !saveSnapshot(snapshot_file, carried, std::cerr)){
+        failed = true;
+    }
 
- 
-    return 0;
+    return failed ? 1 : 0;
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,330 @@
+#include "exchange_engine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+
+/**
+ * Benchmark of the matching engine on synthetic order flow.
+ *
+ * It generates orders with a configurable instrument mix, side ratio, price and quantity distributions and crossing
+ * rate, then measures:
+ * - the latency of every order through validation, matching and report formatting on a single thread, collected in
+ *   a LatencyHistogram, and
+ * - the end to end throughput of the engine (parsing included) on the same orders written as an order file in memory,
+ *   in any of the engine modes.
+ */
+
+/**
+ * Latency histogram with HDR-style log-linear buckets.
+ *
+ * Values below 128 have a bucket each. Above that, every power of two is split into 64 buckets, so a recorded value is
+ * known to within 1.6% at any magnitude, with a fixed array of counters and no allocation while recording.
+ *
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts(kBuckets, 0) {}
+
+    void record(uint64_t value){
+        counts[bucket(value)]++;
+        total++;
+        if (value > max_value){
+            max_value = value;
+        }
+    }
+
+    // returns the highest value of the bucket holding the given fraction (0 to 1) of the recorded values
+    uint64_t percentile(double fraction) const {
+        uint64_t rank = (uint64_t)(fraction * total);
+        if (rank >= total){
+            return max_value;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); i++){
+            seen += counts[i];
+            if (seen > rank){
+                return std::min(highestValue(i), max_value);
+            }
+        }
+        return max_value;
+    }
+
+    uint64_t max() const { return max_value; }
+    uint64_t count() const { return total; }
+
+private:
+    static const int kLinearBits = 7; // values below 2^7 get a bucket each
+    static const size_t kBuckets = (64 - kLinearBits + 2) * 64;
+
+    static size_t bucket(uint64_t value){
+        if (value < (1u << kLinearBits)){
+            return (size_t)value;
+        }
+        int shift = highestBit(value) - kLinearBits + 1; // keeps the 7 top bits, in [64, 128)
+        return (size_t)shift * 64 + (size_t)(value >> shift);
+    }
+
+    static uint64_t highestValue(size_t index){
+        if (index < (1u << kLinearBits)){
+            return index;
+        }
+        int shift = (int)(index / 64) - 1;
+        uint64_t mantissa = index - (uint64_t)shift * 64;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total = 0, max_value = 0;
+};
+
+/**
+ * Shape of the synthetic order flow.
+ *
+ * weights: The relative frequency of each instrument, indexed by the instrument ID.
+ * buy_ratio: The fraction of buy orders.
+ * cross_rate: The fraction of orders priced through the middle price, which usually trade on arrival. The other
+ *             orders are priced on their own side of the middle price and mostly rest in the book.
+ * mid: The middle price of every instrument.
+ * price_levels: The largest distance of a price from the middle price, in ticks.
+ * geometric_prices: Draw the distance from a geometric distribution (most orders near the middle price) instead of
+ *                   a uniform one.
+ * qty_min, qty_max: The range of the quantities, which are multiples of 10.
+ * geometric_qty: Draw the quantities from a geometric distribution (mostly small orders) instead of a uniform one.
+ * invalid_rate: The fraction of orders given an invalid quantity, to exercise the reject path.
+ *
+ */
+struct FlowOptions {
+    size_t orders = 1000000;
+    std::vector<double> weights = std::vector<double>(instruments.size(), 1.0);
+    double buy_ratio = 0.5;
+    double cross_rate = 0.2;
+    Price mid = 50 * kPriceScale;
+    int price_levels = 10;
+    bool geometric_prices = false;
+    int qty_min = 10, qty_max = 1000;
+    bool geometric_qty = false;
+    double invalid_rate = 0.0;
+    uint64_t seed = 1;
+};
+
+/// generates the orders of the flow, numbered from 1 like the rows of an order file
+std::vector<in_ord> generateFlow(const FlowOptions& flow){
+    std::mt19937_64 random(flow.seed);
+    std::discrete_distribution<int> instrument(flow.weights.begin(), flow.weights.end());
+    std::bernoulli_distribution buy(flow.buy_ratio), cross(flow.cross_rate), invalid(flow.invalid_rate);
+    std::uniform_int_distribution<int> uniform_level(1, flow.price_levels);
+    std::geometric_distribution<int> geometric_level(0.3);
+    std::uniform_int_distribution<int> uniform_lots(flow.qty_min / 10, flow.qty_max / 10);
+    std::geometric_distribution<int> geometric_lots(0.2);
+
+    std::vector<in_ord> orders(flow.orders);
+    for (size_t i = 0; i < flow.orders; i++){
+        in_ord& order = orders[i];
+        std::memset(&order, 0, sizeof(order));
+        order.order_no = (int)i + 1;
+        std::snprintf(order.c_ord_id, sizeof(order.c_ord_id), "b%u", (unsigned)(i + 1));
+        order.inst_id = instrument(random);
+        order.side = buy(random) ? 1 : 2;
+
+        int level = flow.geometric_prices ? std::min(1 + geometric_level(random), flow.price_levels) : uniform_level(random);
+        bool crossing = cross(random);
+        int direction = (order.side == 1) == crossing ? 1 : -1; // buy orders rest below the middle price and cross above it
+        Price tick = instruments[order.inst_id].tick_size;
+        order.price = std::max(tick, flow.mid + direction * level * tick);
+
+        int lots = flow.geometric_qty ? flow.qty_min / 10 + geometric_lots(random) : uniform_lots(random);
+        order.qty = std::min(lots * 10, flow.qty_max);
+        if (invalid(random)){
+            order.qty += 5; // not a multiple of 10
+        }
+        order.exec_s = ExecStatus::New;
+    }
+    return orders;
+}
+
+/// writes the orders in the layout of the order files
+std::string toOrderFile(const std::vector<in_ord>& orders){
+    std::string text = "bench.csv,,,,\nClient Order ID,Instrument,Side,Quantity,Price\n";
+    text.reserve(orders.size() * 32);
+    char price[32];
+    for (const in_ord& order : orders){
+        text += order.c_ord_id;
+        text += ',';
+        text += instruments[order.inst_id].name;
+        text += ',';
+        text += std::to_string(order.side);
+        text += ',';
+        text += std::to_string(order.qty);
+        text += ',';
+        text.append(price, formatPrice(price, order.price));
+        text += '\n';
+    }
+    return text;
+}
+
+// stream buffer discarding everything written to it, so the reports are formatted but not stored
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+/// runs every order through validation and matching on the calling thread, timing each one
+template <class Book>
+double measureLatency(const std::vector<in_ord>& orders, std::ostream& out, LatencyHistogram& latency){
+    SymbolTable symbols = instrumentSymbols();
+    ReportWriter report(out, symbols);
+    OrderPool pool;
+    std::vector<std::unique_ptr<Book>> books = makeBooks<Book>(pool);
+
+    auto start = std::chrono::steady_clock::now();
+    for (const in_ord& generated : orders){
+        auto begin = std::chrono::steady_clock::now();
+        in_ord* order = pool.allocate();
+        *order = generated;
+        executeOrder(order, books, pool, report);
+        auto end = std::chrono::steady_clock::now();
+        latency.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// runs the order file through a new engine and returns the elapsed seconds
+template <class Book>
+double measureEngine(const std::string& order_file, std::ostream& out, const EngineOptions& options){
+    std::ostringstream stats;
+    auto start = std::chrono::steady_clock::now();
+    runEngine<Book>(order_file, out, options, stats);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void printUsage(std::ostream& out){
+    out << "Usage: exchange_bench [options]\n"
+           "\n"
+           "Order flow:\n"
+           "  --orders N            number of orders (default 1000000)\n"
+           "  --mix NAME=W,...      relative weights of the instruments (default all equal)\n"
+           "  --buy-ratio R         fraction of buy orders (default 0.5)\n"
+           "  --cross-rate R        fraction of orders priced to trade on arrival (default 0.2)\n"
+           "  --price-mid P         middle price (default 50)\n"
+           "  --price-levels N      largest distance from the middle price in ticks (default 10)\n"
+           "  --price-dist D        uniform or geometric (default uniform)\n"
+           "  --qty-min N, --qty-max N  quantity range (default 10 to 1000)\n"
+           "  --qty-dist D          uniform or geometric (default uniform)\n"
+           "  --invalid-rate R      fraction of orders with an invalid quantity (default 0)\n"
+           "  --seed N              random seed (default 1)\n"
+           "  --csv FILE            also write the orders as an order file\n"
+           "\n"
+           "Engine:\n"
+           "  --mode MODE           single, sharded or pipeline, for the end to end run (default single)\n"
+           "  --book BOOK           map or ladder (default map)\n"
+           "  --shards N            matching threads of the sharded mode (default one per instrument)\n"
+           "  --queue-size N        capacity of the queues between threads (default 4096)\n"
+           "  --report FILE         write the execution reports to a file instead of discarding them\n";
+}
+
+/// reads the instrument weights of a --mix option such as "Rose=4,Tulip=1"
+bool parseMix(std::string text, std::vector<double>& weights){
+    weights.assign(instruments.size(), 0.0);
+    SymbolTable symbols = instrumentSymbols();
+    std::stringstream items(text);
+    std::string item;
+    while (std::getline(items, item, ',')){
+        size_t equals = item.find('=');
+        int id = symbols.find(item.substr(0, equals));
+        if (equals == std::string::npos || !isTraded(id)){
+            return false;
+        }
+        weights[id] = std::atof(item.c_str() + equals + 1);
+    }
+    for (double weight : weights){
+        if (weight > 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[]){
+    FlowOptions flow;
+    EngineOptions options;
+    std::string csv_file, report_file;
+
+    for (int i = 1; i + 1 < argc || (i < argc && (std::strcmp(argv[i], "-h") == 0 || std::strcmp(argv[i], "--help") == 0)); i += 2){
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help"){
+            printUsage(std::cout);
+            return 0;
+        }
+        const char* value = argv[i + 1];
+        bool ok = true;
+        if (arg == "--orders") flow.orders = std::strtoull(value, nullptr, 10);
+        else if (arg == "--mix") ok = parseMix(value, flow.weights);
+        else if (arg == "--buy-ratio") flow.buy_ratio = std::atof(value);
+        else if (arg == "--cross-rate") flow.cross_rate = std::atof(value);
+        else if (arg == "--price-mid") ok = parsePrice(value, flow.mid) && flow.mid > 0;
+        else if (arg == "--price-levels") flow.price_levels = std::atoi(value);
+        else if (arg == "--price-dist") { ok = std::strcmp(value, "uniform") == 0 || std::strcmp(value, "geometric") == 0; flow.geometric_prices = std::strcmp(value, "geometric") == 0; }
+        else if (arg == "--qty-min") flow.qty_min = std::atoi(value);
+        else if (arg == "--qty-max") flow.qty_max = std::atoi(value);
+        else if (arg == "--qty-dist") { ok = std::strcmp(value, "uniform") == 0 || std::strcmp(value, "geometric") == 0; flow.geometric_qty = std::strcmp(value, "geometric") == 0; }
+        else if (arg == "--invalid-rate") flow.invalid_rate = std::atof(value);
+        else if (arg == "--seed") flow.seed = std::strtoull(value, nullptr, 10);
+        else if (arg == "--csv") csv_file = value;
+        else if (arg == "--mode") { std::string mode = value; ok = mode == "single" || mode == "sharded" || mode == "pipeline"; options.mode = mode == "sharded" ? EngineOptions::kSharded : mode == "pipeline" ? EngineOptions::kPipeline : EngineOptions::kSingle; }
+        else if (arg == "--book") { std::string book = value; ok = book == "map" || book == "ladder"; options.ladder_book = book == "ladder"; }
+        else if (arg == "--shards") options.shards = std::atoi(value);
+        else if (arg == "--queue-size") options.queue_size = std::strtoull(value, nullptr, 10);
+        else if (arg == "--report") report_file = value;
+        else ok = false;
+        if (!ok || flow.orders == 0 || flow.price_levels < 1 || flow.qty_min < 10 || flow.qty_max < flow.qty_min
+            || options.shards < 1 || options.queue_size == 0){
+            std::cerr << "Invalid option " << arg << " " << value << "\n\n";
+            printUsage(std::cerr);
+            return 2;
+        }
+    }
+
+    std::vector<in_ord> orders = generateFlow(flow);
+    std::string order_file = toOrderFile(orders);
+    if (!csv_file.empty()){
+        std::ofstream(csv_file, std::ios::binary) << order_file;
+    }
+
+    NullBuffer null_buffer;
+    std::ostream null_out(&null_buffer);
+    std::ofstream report_out;
+    if (!report_file.empty()){
+        report_out.open(report_file, std::ios::binary);
+    }
+    std::ostream& out = report_file.empty() ? null_out : report_out;
+
+    const char* book = options.ladder_book ? "ladder" : "map";
+    const char* mode = options.mode == EngineOptions::kSharded ? "sharded" : options.mode == EngineOptions::kPipeline ? "pipeline" : "single";
+    std::cout << std::fixed << std::setprecision(3)
+              << "Order flow: " << flow.orders << " orders, seed " << flow.seed << ", buy ratio " << flow.buy_ratio
+              << ", cross rate " << flow.cross_rate << ", invalid rate " << flow.invalid_rate << "\n";
+
+    LatencyHistogram latency;
+    double seconds = options.ladder_book ? measureLatency<LadderOrderBook>(orders, out, latency)
+                                         : measureLatency<MapOrderBook>(orders, out, latency);
+    std::cout << "Matching (" << book << " book, one thread): " << seconds << " s, "
+              << (uint64_t)(orders.size() / seconds) << " orders/s\n"
+              << "Latency per order (ns): p50 " << latency.percentile(0.5) << ", p99 " << latency.percentile(0.99)
+              << ", p99.9 " << latency.percentile(0.999) << ", max " << latency.max() << "\n";
+
+    seconds = options.ladder_book ? measureEngine<LadderOrderBook>(order_file, out, options)
+                                  : measureEngine<MapOrderBook>(order_file, out, options);
+    std::cout << "End to end (" << mode << " mode, " << book << " book, parsing and reports included): " << seconds
+              << " s, " << (uint64_t)(orders.size() / seconds) << " orders/s\n";
+
+    return 0;
+}
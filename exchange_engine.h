@@ -0,0 +1,2254 @@
+#ifndef EXCHANGE_ENGINE_H
+#define EXCHANGE_ENGINE_H
+
+/**
+ * Matching engine of the flower exchange: order parsing and validation, the order books, the report writer and the
+ * single-threaded, sharded and pipelined ways of running them. Everything is defined in this header so that each
+ * program (exchange_app, exchange_bench) is built from a single source file.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <string_view>
+#include <charconv>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Prices are fixed point integers counting units of 1/kPriceScale, so "55" is stored as 550000 and "12.5" as 125000.
+ * They are parsed once from the order file and compared, matched and written without any floating point rounding.
+ */
+using Price = long long;
+const int kPriceDecimals = 4;
+const Price kPriceScale = 10000;
+
+// Execution status of an order. It is only turned into text (see kExecStatusText) when the report row is written.
+enum class ExecStatus : uint8_t { New = 0, Reject = 1, Fill = 2, Pfill = 3 };
+const char* const kExecStatusText[] = {"New", "Reject", "Fill", "Pfill"};
+
+// Reasons of rejecting an order, combined as a bitmask. The reason text of a rejected order lists the text of each
+// set bit (see kRejectReasonText) in this order.
+enum RejectReason : uint8_t {
+    kInvalidInstrument = 1 << 0,
+    kInvalidSide = 1 << 1,
+    kInvalidPrice = 1 << 2,
+    kInvalidSize = 1 << 3,
+    kPriceOutOfBand = 1 << 4,
+};
+const char* const kRejectReasonText[] = {"Invalid instrument. ", "Invalid side. ", "Invalid price. ", "Invalid size. ", "Price out of band. "};
+
+/**
+ * This C++ struct, in_ord, represents an order or trade-related data structure with the following fields:
+ * 
+ * c_ord_id: A string representing the Client Order ID of the submitted order.
+ * exec_s: The execution status or state of the order 0 – New, 1 – Rejected, 2 – Fill, 3 - Pfill.
+ * reason: A bitmask of the RejectReason values explaining the errors occured.
+ * order_no: An integer representing the number of the order in the order file. The system generated unique order ID is "ord" followed by it.
+ * side: An integer indicating the order side (e.g., 1 for buy, 2 for sell).
+ * qty: An integer representing the total order quantity.
+ * exec_qty: An integer representing the quantity of the order that has been executed.
+ * price: A fixed point number indicating the price associated with the order (see Price).
+ * inst_id: An integer representing the interned instrument/flower of the order. The traded instruments have the IDs below
+ *          instruments.size() (see instrumentSymbols), and any other name gets a larger ID.
+ * next: A pointer to the next order resting at the same price level of an order book, or to the next free slot of the order pool.
+ *
+ * The struct only holds fixed size fields so that it is trivially copyable and can live in the slots of an OrderPool.
+ * The client order ID is truncated to the size of its field.
+ * 
+ */
+
+struct in_ord{
+
+Price price;
+in_ord* next;
+int order_no;
+int side, qty, exec_qty;
+int inst_id;
+char c_ord_id[16];
+ExecStatus exec_s;
+uint8_t reason;
+
+};
+
+static_assert(std::is_trivially_copyable<in_ord>::value, "in_ord must be trivially copyable to live in the order pool");
+
+/// copies the text into the fixed size field, truncating it if it does not fit
+template <size_t N>
+void copyField(char (&field)[N], std::string_view text) {
+    size_t n = text.copy(field, N - 1);
+    field[n] = '\0';
+}
+
+/**
+ * Trading parameters of an instrument.
+ *
+ * name: The name of the instrument in the order files.
+ * tick_size: The minimum price increment of the instrument. Prices that are not a multiple of it are rejected.
+ * band_low, band_high: The range of prices covered by the price ladder of the instrument (see LadderSide).
+ *
+ */
+struct InstrumentSpec {
+    std::string name;
+    Price tick_size, band_low, band_high;
+};
+
+// Traded instruments. The position of an instrument in this list is its instrument ID,
+// which is used to pick the order book of the instrument. Add new products here.
+const std::vector<InstrumentSpec> instruments = {
+    {"Rose",     100, 100, 1000000}, // tick 0.01, ladder 0.01 - 100.00
+    {"Lavender", 100, 100, 1000000},
+    {"Lotus",    100, 100, 1000000},
+    {"Tulip",    100, 100, 1000000},
+    {"Orchid",   100, 100, 1000000},
+};
+
+/**
+ * Table of interned names.
+ *
+ * Each distinct name is stored once and gets a small integer ID in order of first appearance, so the rest of the
+ * program compares and indexes by ID instead of by string. Names are found by hashing them into an open addressing
+ * table. The table holds at most max_symbols names, so the stored names never move once they are added. Another
+ * thread can therefore read the name of an ID it was handed while the owning thread keeps interning new names.
+ *
+ */
+class SymbolTable {
+public:
+    explicit SymbolTable(size_t max_symbols = 4096) : max_symbols(max_symbols) {
+        size_t capacity = 16;
+        while (capacity < 2 * max_symbols){
+            capacity *= 2;
+        }
+        slots.assign(capacity, -1);
+        names.reserve(max_symbols);
+    }
+
+    // returns the ID of the name, or -1 if it was never interned
+    int find(std::string_view name) const { return slots[slot(name)]; }
+
+    // returns the ID of the name, adding it to the table if needed. Returns -1 if the table is full
+    int intern(std::string_view name){
+        size_t i = slot(name);
+        if (slots[i] < 0){
+            if (names.size() == max_symbols){
+                return -1;
+            }
+            slots[i] = (int)names.size();
+            names.emplace_back(name);
+        }
+        return slots[i];
+    }
+
+    // returns the name of the ID, or an empty name for -1
+    std::string_view name(int id) const { return id < 0 ? std::string_view() : std::string_view(names[id]); }
+    size_t size() const { return names.size(); }
+
+private:
+    // index of the slot holding the name, or of the empty slot where it would be added
+    size_t slot(std::string_view name) const {
+        uint64_t hash = 14695981039346656037ULL; // FNV-1a
+        for (char c : name){
+            hash = (hash ^ (unsigned char)c) * 1099511628211ULL;
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = (size_t)hash & mask;
+        while (slots[i] >= 0 && names[slots[i]] != name){
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    size_t max_symbols;
+    std::vector<std::string> names;
+    std::vector<int> slots; // ID stored in each slot, -1 for an empty slot
+};
+
+/// returns a symbol table of instrument names in which each traded instrument is interned with its instrument ID
+inline SymbolTable instrumentSymbols() {
+    SymbolTable symbols;
+    for (const InstrumentSpec& spec : instruments){
+        symbols.intern(spec.name);
+    }
+    return symbols;
+}
+
+/// checks if the instrument ID belongs to a traded instrument
+inline bool isTraded(int inst_id) {
+    return inst_id >= 0 && inst_id < (int)instruments.size();
+}
+
+/**
+ * Parses the decimal number at the start of the text, such as "55", "-1" or "12.25", into a fixed point Price.
+ * Like std::stod, leading spaces are skipped and anything after the number is ignored.
+ * Returns false if the text does not start with a number or the number has more than kPriceDecimals decimal places.
+ */
+inline bool parsePrice(std::string_view text, Price& price) {
+    size_t i = text.find_first_not_of(' ');
+    if (i == std::string_view::npos){
+        return false;
+    }
+    bool negative = text[i] == '-';
+    if (negative){
+        i++;
+    }
+
+    Price units = 0;
+    int digits = 0, decimals = -1; // decimals stays -1 until the decimal point is read
+    for (; i < text.size(); i++){
+        char c = text[i];
+        if (c == '.' && decimals < 0){
+            decimals = 0;
+        }
+        else if (c >= '0' && c <= '9'){
+            if (decimals == kPriceDecimals || units >= kPriceScale * 100000000LL){
+                return false; // too many decimal places, or too large to scale
+            }
+            units = units * 10 + (c - '0');
+            digits++;
+            if (decimals >= 0){
+                decimals++;
+            }
+        }
+        else{
+            break;
+        }
+    }
+    if (digits == 0){
+        return false;
+    }
+
+    for (int d = decimals < 0 ? 0 : decimals; d < kPriceDecimals; d++){ // scale the number up to kPriceDecimals decimal places
+        units *= 10;
+    }
+    price = negative ? -units : units;
+    return true;
+}
+
+/**
+ * Writes the price as a decimal number into the buffer, without trailing zeros after the decimal point
+ * (550000 is written as "55" and 125000 as "12.5"). Returns the end of the written text.
+ */
+inline char* formatPrice(char* out, Price price) {
+    if (price < 0){
+        *out++ = '-';
+        price = -price;
+    }
+
+    char digits[24];
+    int n = 0;
+    Price whole = price / kPriceScale;
+    do {
+        digits[n++] = char('0' + whole % 10);
+        whole /= 10;
+    } while (whole > 0);
+    while (n > 0){
+        *out++ = digits[--n];
+    }
+
+    Price fraction = price % kPriceScale;
+    if (fraction != 0){
+        *out++ = '.';
+        for (Price unit = kPriceScale / 10; fraction != 0; unit /= 10){
+            *out++ = char('0' + fraction / unit);
+            fraction %= unit;
+        }
+    }
+    return out;
+}
+
+/**
+ * FIFO queue of the orders resting at one price level of an order book.
+ *
+ * The orders are chained through their 'next' pointer, so queueing an order is O(1) and does not allocate memory.
+ * The order at the front is the oldest one at this price and is the first one to be matched.
+ *
+ */
+struct PriceLevel {
+    in_ord* head = nullptr;
+    in_ord* tail = nullptr;
+
+    bool empty() const { return head == nullptr; }
+    in_ord* front() const { return head; }
+
+    // appends the order at the back of the queue
+    void push_back(in_ord* order){
+        order->next = nullptr;
+        if (tail == nullptr){
+            head = order;
+        }
+        else{
+            tail->next = order;
+        }
+        tail = order;
+    }
+
+    // removes the order at the front of the queue
+    void pop_front(){
+        head = head->next;
+        if (head == nullptr){
+            tail = nullptr;
+        }
+    }
+};
+
+/**
+ * Pool of fixed size in_ord slots.
+ *
+ * Slots are handed out from slabs of slab_orders orders and released slots are kept in a free list linked through
+ * in_ord::next, so after the first slabs are allocated, orders are created and released without calling the heap.
+ * A new slab is only allocated when every slot is in use.
+ *
+ */
+class OrderPool {
+public:
+    explicit OrderPool(size_t slab_orders = 4096) : slab_orders(slab_orders) { addSlab(); }
+    OrderPool(const OrderPool&) = delete;
+    OrderPool& operator=(const OrderPool&) = delete;
+
+    // returns a free order slot. The fields of the slot are not initialized
+    in_ord* allocate(){
+        if (free_list == nullptr){
+            addSlab();
+        }
+        in_ord* order = free_list;
+        free_list = order->next;
+        in_use++;
+        if (in_use > high_water){
+            high_water = in_use;
+        }
+        return order;
+    }
+
+    // returns the order slot to the free list
+    void release(in_ord* order){
+        order->next = free_list;
+        free_list = order;
+        in_use--;
+    }
+
+    // writes the allocator statistics
+    void printStats(std::ostream& out) const {
+        out << "Order pool: " << slabs.size() << " slabs of " << slab_orders << " orders, "
+            << "high-water mark " << high_water << " orders, "
+            << in_use << " orders in use\n";
+    }
+
+private:
+    // allocates a new slab and pushes its slots on the free list
+    void addSlab(){
+        slabs.emplace_back(new in_ord[slab_orders]);
+        in_ord* slab = slabs.back().get();
+        for (size_t i = slab_orders; i > 0; i--){
+            slab[i - 1].next = free_list;
+            free_list = &slab[i - 1];
+        }
+    }
+
+    size_t slab_orders;
+    std::vector<std::unique_ptr<in_ord[]>> slabs;
+    in_ord* free_list = nullptr;
+    size_t in_use = 0, high_water = 0;
+};
+
+/**
+ * Read-only memory mapping of a whole file, so the order file can be parsed in place without copying it.
+ */
+class MappedFile {
+public:
+    explicit MappedFile(const char* path);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool is_open() const { return opened; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    bool opened = false;
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#endif
+};
+
+#ifdef _WIN32
+inline MappedFile::MappedFile(const char* path){
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE){
+        return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size)){
+        return;
+    }
+    length = (size_t)file_size.QuadPart;
+    opened = true;
+    if (length == 0){ // an empty file cannot be mapped
+        return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    bytes = mapping ? (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (bytes == nullptr){
+        opened = false;
+        length = 0;
+    }
+}
+
+inline MappedFile::~MappedFile(){
+    if (bytes != nullptr){
+        UnmapViewOfFile(bytes);
+    }
+    if (mapping != nullptr){
+        CloseHandle(mapping);
+    }
+    if (file != INVALID_HANDLE_VALUE){
+        CloseHandle(file);
+    }
+}
+#else
+inline MappedFile::MappedFile(const char* path){
+    int fd = open(path, O_RDONLY);
+    if (fd < 0){
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0){
+        length = (size_t)st.st_size;
+        opened = true;
+        if (length > 0){ // an empty file cannot be mapped
+            void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED){
+                opened = false;
+                length = 0;
+            }
+            else{
+                bytes = (const char*)mapped;
+                madvise(mapped, length, MADV_SEQUENTIAL); // the file is read once from start to end
+            }
+        }
+    }
+    close(fd); // the mapping stays valid after the file is closed
+}
+
+inline MappedFile::~MappedFile(){
+    if (bytes != nullptr){
+        munmap((void*)bytes, length);
+    }
+}
+#endif
+
+// number of columns of the order file that are read: Client Order ID, Instrument, Side, Quantity, Price
+const int kOrderFields = 5;
+
+/**
+ * Splits a line of the order file at the commas into the first max_fields fields.
+ * The fields point into the line, and fields missing from the line are left empty.
+ */
+inline void splitFields(std::string_view line, std::string_view* fields, int max_fields){
+    const char* pos = line.data();
+    const char* end = pos + line.size();
+    for (int i = 0; i < max_fields; i++){
+        const char* comma = pos < end ? (const char*)std::memchr(pos, ',', end - pos) : nullptr;
+        const char* field_end = comma ? comma : end;
+        fields[i] = std::string_view(pos, field_end - pos);
+        pos = comma ? comma + 1 : end;
+    }
+}
+
+/// reads the integer at the start of the field like std::stoi, or returns 0 if the field does not start with a number
+inline int parseInt(std::string_view text){
+    size_t i = text.find_first_not_of(' ');
+    if (i == std::string_view::npos){
+        return 0;
+    }
+    int value = 0;
+    if (std::from_chars(text.data() + i, text.data() + text.size(), value).ec != std::errc()){
+        return 0;
+    }
+    return value;
+}
+
+/**
+ * Reader of the order rows in the contents of an order file.
+ *
+ * The lines are found with memchr and split in place, so the fields of a row point into the file contents.
+ * The first two lines, which hold the name of the file and the header column names, and blank lines are skipped.
+ * The CSV execution report has the same layout, and is read by giving the number of its fields.
+ *
+ */
+class OrderReader {
+public:
+    explicit OrderReader(std::string_view input, int fields = kOrderFields)
+        : pos(input.data()), end(input.data() + input.size()), fields(fields) {}
+
+    // reads the fields of the next order row. Returns false at the end of the file
+    bool next(std::string_view* row){
+        while (pos < end){
+            const char* eol = (const char*)std::memchr(pos, '\n', end - pos);
+            if (eol == nullptr){ // the last line may not end with a newline
+                eol = end;
+            }
+            std::string_view line(pos, eol - pos);
+            pos = eol < end ? eol + 1 : end;
+            if (!line.empty() && line.back() == '\r'){
+                line.remove_suffix(1);
+            }
+
+            if (line_no < 3){ //skip first two lines which contains the name and header column name of the csv file
+                line_no += 1;
+                continue;
+            }
+            if (line.empty()){ // skip blank lines
+                continue;
+            }
+            splitFields(line, row, fields); // break the line into its columns
+            return true;
+        }
+        return false;
+    }
+
+private:
+    const char* pos;
+    const char* end;
+    int fields;
+    int line_no = 1;
+};
+
+/// fills the in_ord struct using the fields of a row in the input order
+inline void record(const std::string_view* row, int order_no, SymbolTable& symbols, in_ord* order){
+    copyField(order->c_ord_id, row[0]);
+    order->inst_id = symbols.intern(row[1]); // the instrument ID is assigned once here and used to find the order book
+    order->side = parseInt(row[2]);
+    if (!parsePrice(row[4], order->price)){
+        order->price = 0; // a price that cannot be read is rejected as an invalid price
+    }
+    order->qty = parseInt(row[3]);
+    order->exec_qty = 0;
+    order->exec_s = ExecStatus::New;
+    order->reason = 0;
+    order->order_no = order_no;
+    order->next = nullptr;
+}
+
+/// source of the orders of a CSV order file, numbering them in file order from first_order_no
+class CsvOrderSource {
+public:
+    CsvOrderSource(std::string_view input, SymbolTable& symbols, int first_order_no = 1)
+        : reader(input), symbols(symbols), order_no(first_order_no) {}
+
+    // fills the order from the next row. Returns false at the end of the file
+    bool next(in_ord* order){
+        std::string_view row[kOrderFields];
+        if (!reader.next(row)){
+            return false;
+        }
+        record(row, order_no, symbols, order); // create the order struct using the row in the input order
+        order_no += 1; // increment the order number
+        return true;
+    }
+
+    // number the next order would get
+    int nextOrderNo() const { return order_no; }
+
+private:
+    OrderReader reader;
+    SymbolTable& symbols;
+    int order_no;
+};
+
+/**
+ * Binary order and report files.
+ *
+ * A binary file starts with a BinaryFileHeader, which holds the magic of the kind of file and the size of its records,
+ * followed by fixed size records: BinaryOrder for an order file and BinaryReport for an execution report. The numbers
+ * are stored in the byte order of the machine (little endian on the supported platforms). The records hold the values
+ * already parsed from the CSV layout, so reading an order is a copy and writing a report formats no text.
+ *
+ * Text fields are NUL padded, and truncated to the size of their field like the client order ID of in_ord.
+ *
+ */
+struct BinaryFileHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+};
+
+const char kBinaryOrderMagic[8] = {'F', 'X', 'O', 'R', 'D', 'E', 'R', 'S'};
+const char kBinaryReportMagic[8] = {'F', 'X', 'R', 'E', 'P', 'O', 'R', 'T'};
+
+// one row of an order file, as read by record()
+struct BinaryOrder {
+    Price price;
+    int32_t side, qty;
+    char c_ord_id[16];
+    char instrument[16];
+};
+
+// one row of an execution report. time is the transaction time in milliseconds since the epoch
+struct BinaryReport {
+    Price price;
+    int64_t time;
+    int32_t order_no, side, exec_qty;
+    char c_ord_id[16];
+    char instrument[16];
+    uint8_t exec_s, reason;
+    uint8_t padding[2];
+};
+
+static_assert(sizeof(BinaryFileHeader) == 16 && sizeof(BinaryOrder) == 48 && sizeof(BinaryReport) == 64,
+              "the binary records must keep their layout");
+
+/// checks if the contents start with the header of a binary file of the given kind
+inline bool isBinaryFile(std::string_view input, const char (&magic)[8]){
+    return input.size() >= sizeof(BinaryFileHeader) && std::memcmp(input.data(), magic, sizeof(magic)) == 0;
+}
+
+/**
+ * Returns the records of a binary file of the given kind, without an incomplete record at the end. Returns a null view
+ * if the contents are not such a file, or if its records do not have the expected size.
+ */
+inline std::string_view binaryRecords(std::string_view input, const char (&magic)[8], uint32_t record_size){
+    BinaryFileHeader header;
+    if (!isBinaryFile(input, magic)){
+        return std::string_view();
+    }
+    std::memcpy(&header, input.data(), sizeof(header));
+    if (header.record_size != record_size){
+        return std::string_view();
+    }
+    size_t count = (input.size() - sizeof(header)) / record_size;
+    return std::string_view(input.data() + sizeof(header), count * record_size);
+}
+
+/// copies the text into the NUL padded field, truncating it if it does not fit
+template <size_t N>
+void padField(char (&field)[N], std::string_view text){
+    std::memset(field, 0, N);
+    text.copy(field, N);
+}
+
+/// returns the text of a NUL padded field
+template <size_t N>
+std::string_view fieldText(const char (&field)[N]){
+    const char* end = (const char*)std::memchr(field, '\0', N);
+    return std::string_view(field, end ? end - field : N);
+}
+
+/**
+ * Source of the orders of a binary order file, numbering them in file order from first_order_no.
+ *
+ * The records are copied straight out of the contents, which are usually a MappedFile. A file whose record size is not
+ * the one of BinaryOrder is not valid, and an incomplete record at the end of the file is ignored.
+ *
+ */
+class BinaryOrderSource {
+public:
+    BinaryOrderSource(std::string_view input, SymbolTable& symbols, int first_order_no = 1)
+        : symbols(symbols), records(binaryRecords(input, kBinaryOrderMagic, sizeof(BinaryOrder))), first_order_no(first_order_no) {}
+
+    bool valid() const { return records.data() != nullptr; }
+
+    // fills the order from the next record. Returns false at the end of the file
+    bool next(in_ord* order){
+        if (read * sizeof(BinaryOrder) == records.size()){
+            return false;
+        }
+        BinaryOrder row;
+        std::memcpy(&row, records.data() + read * sizeof(BinaryOrder), sizeof(row)); // the records may not be aligned
+        read += 1;
+
+        std::memcpy(order->c_ord_id, row.c_ord_id, sizeof(order->c_ord_id));
+        order->c_ord_id[sizeof(order->c_ord_id) - 1] = '\0';
+        order->inst_id = symbols.intern(fieldText(row.instrument));
+        order->side = row.side;
+        order->price = row.price;
+        order->qty = row.qty;
+        order->exec_qty = 0;
+        order->exec_s = ExecStatus::New;
+        order->reason = 0;
+        order->order_no = first_order_no + (int)read - 1;
+        order->next = nullptr;
+        return true;
+    }
+
+    // number the next order would get
+    int nextOrderNo() const { return first_order_no + (int)read; }
+
+private:
+    SymbolTable& symbols;
+    std::string_view records;
+    int first_order_no;
+    size_t read = 0;
+};
+
+/**
+ * Options of the order journal.
+ *
+ * sync_orders: Sync the journal to disk once this many orders wait for it, or 0 for no limit.
+ * sync_micros: Sync the journal to disk once the oldest waiting order has waited this many microseconds, or 0 for no
+ *              limit. The time is checked when an order is appended.
+ *
+ * With both limits at 0 the journal is written whenever its buffer fills but never synced, so it is only as durable as
+ * the operating system makes it.
+ *
+ */
+struct JournalOptions {
+    size_t sync_orders = 0;
+    long long sync_micros = 1000;
+};
+
+// journal file: a BinaryFileHeader followed by one JournalRecord per accepted order, in the order they were matched
+const char kJournalMagic[8] = {'F', 'X', 'J', 'O', 'U', 'R', 'N', 'L'};
+
+struct JournalRecord {
+    Price price;
+    int32_t order_no, side, qty, reserved;
+    char c_ord_id[16];
+    char instrument[16];
+};
+
+static_assert(sizeof(JournalRecord) == 56, "the journal records must keep their layout");
+
+/**
+ * Append-only write-ahead journal of the orders accepted for matching.
+ *
+ * Orders are appended to a buffer and written and synced to the file together in group commits, when the limits of
+ * the JournalOptions are reached, so the cost of a sync is shared by every order of the group. The report writer
+ * commits the journal before it writes report rows to their file (see ReportWriter::setJournal), so no report reaches
+ * the file before the orders it comes from reach the journal. Replaying the journal rebuilds the books.
+ *
+ * An existing journal is appended to. An incomplete record left at its end by a crash is cut off first. append and
+ * commit may be called from different threads.
+ *
+ */
+class Journal {
+public:
+    Journal(const std::string& path, const JournalOptions& options) : options(options) {
+        buffer.reserve(kBufferRecords * sizeof(JournalRecord));
+        open(path);
+    }
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+    ~Journal(){
+        commit();
+        close();
+    }
+
+    bool is_open() const { return opened; }
+
+    // appends the order to the journal, committing the group if one of the limits is reached
+    void append(const in_ord* order){
+        JournalRecord record = {};
+        record.price = order->price;
+        record.order_no = order->order_no;
+        record.side = order->side;
+        record.qty = order->qty;
+        std::memcpy(record.c_ord_id, order->c_ord_id, sizeof(record.c_ord_id));
+        padField(record.instrument, isTraded(order->inst_id) ? std::string_view(instruments[order->inst_id].name) : std::string_view());
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (waiting == 0){
+            oldest = now;
+        }
+        buffer.insert(buffer.end(), (const char*)&record, (const char*)&record + sizeof(record));
+        waiting++;
+        appended++;
+        bool full = waiting == kBufferRecords || (options.sync_orders > 0 && waiting >= options.sync_orders);
+        bool late = options.sync_micros > 0 && now - oldest >= std::chrono::microseconds(options.sync_micros);
+        if (full || late){
+            commitLocked();
+        }
+    }
+
+    // writes the waiting orders to the file, and syncs them unless the journal is never synced
+    void commit(){
+        std::lock_guard<std::mutex> lock(mutex);
+        commitLocked();
+    }
+
+    void printStats(std::ostream& out){
+        std::lock_guard<std::mutex> lock(mutex);
+        out << "Journal: " << appended << " orders in " << commits << " commits, " << syncs << " syncs, largest group "
+            << largest_group << " orders\n";
+    }
+
+private:
+    static const size_t kBufferRecords = 4096;
+
+    void commitLocked(){
+        if (waiting == 0 || !opened){
+            return;
+        }
+        writeAll(buffer.data(), buffer.size());
+        if (options.sync_orders > 0 || options.sync_micros > 0){
+            sync();
+            syncs++;
+        }
+        commits++;
+        largest_group = waiting > largest_group ? waiting : largest_group;
+        buffer.clear();
+        waiting = 0;
+    }
+
+#ifdef _WIN32
+    void open(const std::string& path){
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE){
+            return;
+        }
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        opened = prepare((size_t)size.QuadPart);
+    }
+
+    bool readHeader(BinaryFileHeader& header){
+        DWORD read = 0;
+        return ReadFile(file, &header, sizeof(header), &read, nullptr) && read == sizeof(header);
+    }
+
+    void truncate(size_t size){
+        LARGE_INTEGER end;
+        end.QuadPart = (LONGLONG)size;
+        SetFilePointerEx(file, end, nullptr, FILE_BEGIN);
+        SetEndOfFile(file);
+    }
+
+    void seekEnd(){
+        LARGE_INTEGER zero = {};
+        SetFilePointerEx(file, zero, nullptr, FILE_END);
+    }
+
+    void writeAll(const char* bytes, size_t n){
+        DWORD written = 0;
+        WriteFile(file, bytes, (DWORD)n, &written, nullptr);
+    }
+
+    void sync() { FlushFileBuffers(file); }
+
+    void close(){
+        if (file != INVALID_HANDLE_VALUE){
+            CloseHandle(file);
+        }
+    }
+
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    void open(const std::string& path){
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0){
+            return;
+        }
+        struct stat st;
+        opened = fstat(fd, &st) == 0 && prepare((size_t)st.st_size);
+    }
+
+    bool readHeader(BinaryFileHeader& header){
+        return pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header);
+    }
+
+    void truncate(size_t size){
+        if (ftruncate(fd, (off_t)size) != 0){
+            opened = false;
+        }
+    }
+
+    void seekEnd() { lseek(fd, 0, SEEK_END); }
+
+    void writeAll(const char* bytes, size_t n){
+        while (n > 0){
+            ssize_t written = ::write(fd, bytes, n);
+            if (written <= 0){
+                return;
+            }
+            bytes += written;
+            n -= (size_t)written;
+        }
+    }
+
+    void sync(){
+#ifdef __APPLE__
+        fsync(fd);
+#else
+        fdatasync(fd); // the data of the journal, without the metadata it does not need
+#endif
+    }
+
+    void close(){
+        if (fd >= 0){
+            ::close(fd);
+        }
+    }
+
+    int fd = -1;
+#endif
+
+    // writes the header of a new journal, or checks the header of an existing one and cuts off an incomplete record
+    bool prepare(size_t size){
+        if (size == 0){
+            BinaryFileHeader header = {};
+            std::memcpy(header.magic, kJournalMagic, sizeof(header.magic));
+            header.record_size = sizeof(JournalRecord);
+            writeAll((const char*)&header, sizeof(header));
+            sync();
+            return true;
+        }
+        BinaryFileHeader header;
+        if (size < sizeof(header) || !readHeader(header) || std::memcmp(header.magic, kJournalMagic, sizeof(header.magic)) != 0
+            || header.record_size != sizeof(JournalRecord)){
+            return false; // not a journal of this version
+        }
+        size_t complete = sizeof(header) + (size - sizeof(header)) / sizeof(JournalRecord) * sizeof(JournalRecord);
+        if (complete != size){
+            truncate(complete);
+        }
+        seekEnd();
+        return true;
+    }
+
+    JournalOptions options;
+    bool opened = false;
+    std::mutex mutex;
+    std::vector<char> buffer; // records waiting for the next commit
+    size_t waiting = 0;
+    std::chrono::steady_clock::time_point oldest; // time the oldest waiting record was appended
+    size_t appended = 0, commits = 0, syncs = 0, largest_group = 0;
+};
+
+/**
+ * Source of the orders of a journal file, which replays the accepted orders with the numbers they had. Orders numbered
+ * below first_order_no are already in the books restored from a snapshot, and are skipped.
+ */
+class JournalOrderSource {
+public:
+    JournalOrderSource(std::string_view input, SymbolTable& symbols, int first_order_no = 1)
+        : symbols(symbols), records(binaryRecords(input, kJournalMagic, sizeof(JournalRecord))), next_order_no(first_order_no) {}
+
+    bool valid() const { return records.data() != nullptr; }
+
+    // fills the order from the next record. Returns false at the end of the journal
+    bool next(in_ord* order){
+        JournalRecord row;
+        do {
+            if (read * sizeof(JournalRecord) == records.size()){
+                return false;
+            }
+            std::memcpy(&row, records.data() + read * sizeof(JournalRecord), sizeof(row));
+            read += 1;
+        } while (row.order_no < next_order_no);
+
+        copyField(order->c_ord_id, fieldText(row.c_ord_id));
+        order->inst_id = symbols.intern(fieldText(row.instrument));
+        order->side = row.side;
+        order->price = row.price;
+        order->qty = row.qty;
+        order->exec_qty = 0;
+        order->exec_s = ExecStatus::New;
+        order->reason = 0;
+        order->order_no = row.order_no;
+        order->next = nullptr;
+        next_order_no = row.order_no + 1;
+        return true;
+    }
+
+    // number following the last replayed order. Rejected orders are not journaled, so orders rejected after the last
+    // accepted one are not counted
+    int nextOrderNo() const { return next_order_no; }
+
+private:
+    SymbolTable& symbols;
+    std::string_view records;
+    size_t read = 0;
+    int next_order_no;
+};
+
+/// writes the integer as decimal text into the buffer and returns the end of the written text
+inline char* formatInt(char* out, long long value) {
+    unsigned long long magnitude = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+    if (value < 0){
+        *out++ = '-';
+    }
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    while (n > 0){
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+/**
+ * One row of the execution report as a fixed size record, holding a copy of the order fields it needs, so that a
+ * report can be handed to another thread while the order itself keeps changing in its book.
+ */
+struct exec_rep {
+    Price price;
+    int order_no, side, exec_qty, inst_id;
+    char c_ord_id[16];
+    ExecStatus exec_s;
+    uint8_t reason;
+};
+
+/// creates the execution report of the order with its current status, at the given price
+inline exec_rep makeExecRep(const in_ord* order, Price price) {
+    exec_rep rep;
+    rep.price = price;
+    rep.order_no = order->order_no;
+    rep.side = order->side;
+    rep.exec_qty = order->exec_qty;
+    rep.inst_id = order->inst_id;
+    std::memcpy(rep.c_ord_id, order->c_ord_id, sizeof(rep.c_ord_id));
+    rep.exec_s = order->exec_s;
+    rep.reason = order->reason;
+    return rep;
+}
+
+// layout of an execution report: the CSV text layout or BinaryReport records
+enum class ReportFormat { Csv, Binary };
+
+/// returns the current time in milliseconds since the epoch
+inline long long currentTimeMs(){
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Writer of the execution report.
+ *
+ * Rows are formatted by hand into a reusable buffer, which is written to the output stream in blocks of buffer_size
+ * bytes. The transaction time is written as "YYYY/MM/DD-HH:MM:SS.mmm". The date and seconds part is only formatted
+ * again when the clock moves to the next second, so most rows only format the milliseconds.
+ *
+ * With the Binary format every row is a BinaryReport record copied into the same buffer, and no text is formatted.
+ *
+ */
+class ReportWriter {
+public:
+    ReportWriter(std::ostream& out, const SymbolTable& symbols, size_t buffer_size = 1 << 20, ReportFormat format = ReportFormat::Csv)
+        : out(out), symbols(symbols), buffer(buffer_size < 2 * kMaxRow ? 2 * kMaxRow : buffer_size), format(format) {}
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+    ~ReportWriter() { flush(); }
+
+    // writes the name of the report and the header column names, or the header of a binary report
+    void writeHeader(){
+        if (format == ReportFormat::Binary){
+            BinaryFileHeader header = {};
+            std::memcpy(header.magic, kBinaryReportMagic, sizeof(header.magic));
+            header.record_size = sizeof(BinaryReport);
+            append((const char*)&header, sizeof(header));
+            return;
+        }
+        append("execution_rep.csv,,,,,\n"
+               "Order ID,Client Order ID,Instrument,Side,Exec Status,Quantity,Price,Reason,Transaction time\n");
+    }
+
+    /**
+     * Writes the order's information, including its ID, customer ID, instrument, side, execution status,
+     * execution quantity, the given price, reason, and current time as one row of the report.
+     */
+    void writeOrder(const in_ord* order, Price price){
+        write(makeExecRep(order, price));
+    }
+
+    // writes the report as one row, adding the current time
+    void write(const exec_rep& rep){
+        write(rep, currentTimeMs());
+    }
+
+    /**
+     * Writes the report as one row with the given transaction time, in milliseconds since the epoch.
+     * The instrument ID, the execution status and the reject reasons are turned into their text here.
+     */
+    void write(const exec_rep& rep, long long time){
+        if (buffer.size() - used < kMaxRow + symbols.name(rep.inst_id).size()){
+            flush();
+        }
+        if (format == ReportFormat::Binary){
+            writeBinary(rep, time);
+            return;
+        }
+        char* p = buffer.data() + used;
+        p = appendText(p, "ord");
+        p = formatInt(p, rep.order_no);
+        *p++ = ',';
+        p = appendText(p, rep.c_ord_id);
+        *p++ = ',';
+        std::string_view inst = symbols.name(rep.inst_id);
+        std::memcpy(p, inst.data(), inst.size());
+        p += inst.size();
+        *p++ = ',';
+        p = formatInt(p, rep.side);
+        *p++ = ',';
+        p = appendText(p, kExecStatusText[(int)rep.exec_s]);
+        *p++ = ',';
+        p = formatInt(p, rep.exec_qty);
+        *p++ = ',';
+        p = formatPrice(p, rep.price);
+        *p++ = ',';
+        for (int bit = 0; rep.reason >> bit != 0; bit++){
+            if (rep.reason & (1 << bit)){
+                p = appendText(p, kRejectReasonText[bit]);
+            }
+        }
+        *p++ = ',';
+        p = formatTime(p, time);
+        *p++ = '\n';
+        used = p - buffer.data();
+    }
+
+    // makes the writer commit the journal before it writes any row to the output stream
+    void setJournal(Journal* orders_journal) { journal = orders_journal; }
+
+    // writes the buffered rows to the output stream
+    void flush(){
+        if (journal != nullptr){
+            journal->commit(); // the orders of the rows reach the journal first
+        }
+        if (used > 0){
+            out.write(buffer.data(), used);
+            used = 0;
+        }
+        out.flush();
+    }
+
+private:
+    // upper bound of the length of a row besides the instrument name, which is checked separately
+    static const size_t kMaxRow = 512;
+
+    static char* appendText(char* p, const char* text){
+        while (*text != '\0'){
+            *p++ = *text++;
+        }
+        return p;
+    }
+
+    void append(const char* text){
+        append(text, std::strlen(text));
+    }
+
+    void append(const char* bytes, size_t n){
+        if (buffer.size() - used < n){
+            flush();
+        }
+        std::memcpy(buffer.data() + used, bytes, n);
+        used += n;
+    }
+
+    void writeBinary(const exec_rep& rep, long long time){
+        BinaryReport row = {};
+        row.price = rep.price;
+        row.time = time;
+        row.order_no = rep.order_no;
+        row.side = rep.side;
+        row.exec_qty = rep.exec_qty;
+        std::memcpy(row.c_ord_id, rep.c_ord_id, sizeof(row.c_ord_id));
+        symbols.name(rep.inst_id).copy(row.instrument, sizeof(row.instrument));
+        row.exec_s = (uint8_t)rep.exec_s;
+        row.reason = rep.reason;
+        std::memcpy(buffer.data() + used, &row, sizeof(row));
+        used += sizeof(row);
+    }
+
+    // writes the time, formatting the date and seconds only when the second changes
+    char* formatTime(char* p, long long ms){
+        long long second = ms / 1000;
+        if (second != cached_second){
+            std::time_t time = (std::time_t)second;
+            std::tm timeInfo;
+#ifdef _WIN32
+            localtime_s(&timeInfo, &time);
+#else
+            localtime_r(&time, &timeInfo);
+#endif
+            std::strftime(time_prefix, sizeof(time_prefix), "%Y/%m/%d-%H:%M:%S.", &timeInfo);
+            time_prefix_length = std::strlen(time_prefix);
+            cached_second = second;
+        }
+        std::memcpy(p, time_prefix, time_prefix_length);
+        p += time_prefix_length;
+        int millis = (int)(ms % 1000);
+        *p++ = char('0' + millis / 100);
+        *p++ = char('0' + millis / 10 % 10);
+        *p++ = char('0' + millis % 10);
+        return p;
+    }
+
+    std::ostream& out;
+    const SymbolTable& symbols; // names of the instrument IDs
+    std::vector<char> buffer;
+    size_t used = 0;
+    ReportFormat format;
+    Journal* journal = nullptr;
+    long long cached_second = -1;
+    char time_prefix[32];
+    size_t time_prefix_length = 0;
+};
+
+/// writes the header of a binary file of the given kind
+inline void writeBinaryHeader(std::ostream& out, const char (&magic)[8], uint32_t record_size){
+    BinaryFileHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(header.magic));
+    header.record_size = record_size;
+    out.write((const char*)&header, sizeof(header));
+}
+
+/// converts a CSV order file into a binary order file, parsing the fields like record(). Returns the number of orders
+inline size_t convertOrdersToBinary(std::string_view csv, std::ostream& out){
+    writeBinaryHeader(out, kBinaryOrderMagic, sizeof(BinaryOrder));
+    OrderReader reader(csv);
+    std::string_view row[kOrderFields];
+    size_t count = 0;
+    while (reader.next(row)){
+        BinaryOrder order = {};
+        copyField(order.c_ord_id, row[0]); // truncated like the client order ID of in_ord
+        padField(order.instrument, row[1]);
+        order.side = parseInt(row[2]);
+        order.qty = parseInt(row[3]);
+        if (!parsePrice(row[4], order.price)){
+            order.price = 0; // a price that cannot be read is rejected as an invalid price
+        }
+        out.write((const char*)&order, sizeof(order));
+        count++;
+    }
+    return count;
+}
+
+/// converts a binary order file into a CSV order file whose first line holds the title. Returns the number of orders
+inline size_t convertOrdersToCsv(std::string_view binary, std::string_view title, std::ostream& out){
+    out << title << ",,,,\nClient Order ID,Instrument,Side,Quantity,Price\n";
+    std::string_view records = binaryRecords(binary, kBinaryOrderMagic, sizeof(BinaryOrder));
+    size_t count = records.size() / sizeof(BinaryOrder);
+    char line[128];
+    for (size_t i = 0; i < count; i++){
+        BinaryOrder order;
+        std::memcpy(&order, records.data() + i * sizeof(BinaryOrder), sizeof(order));
+        char* p = line;
+        std::string_view fields[] = {fieldText(order.c_ord_id), fieldText(order.instrument)};
+        for (std::string_view field : fields){
+            p += field.copy(p, field.size());
+            *p++ = ',';
+        }
+        p = formatInt(p, order.side);
+        *p++ = ',';
+        p = formatInt(p, order.qty);
+        *p++ = ',';
+        p = formatPrice(p, order.price);
+        *p++ = '\n';
+        out.write(line, p - line);
+    }
+    return count;
+}
+
+/// reads a transaction time written as "YYYY/MM/DD-HH:MM:SS.mmm" in local time, in milliseconds since the epoch
+inline long long parseTime(std::string_view text){
+    if (text.size() < 23){
+        return 0;
+    }
+    std::tm time_info = {};
+    time_info.tm_year = parseInt(text.substr(0, 4)) - 1900;
+    time_info.tm_mon = parseInt(text.substr(5, 2)) - 1;
+    time_info.tm_mday = parseInt(text.substr(8, 2));
+    time_info.tm_hour = parseInt(text.substr(11, 2));
+    time_info.tm_min = parseInt(text.substr(14, 2));
+    time_info.tm_sec = parseInt(text.substr(17, 2));
+    time_info.tm_isdst = -1; // let mktime find out if daylight saving time applies
+    return (long long)std::mktime(&time_info) * 1000 + parseInt(text.substr(20, 3));
+}
+
+// number of columns of the CSV execution report
+const int kReportFields = 9;
+
+/**
+ * Converts a CSV execution report into a binary report. The status and the reason texts are turned back into their
+ * codes, and the transaction time into milliseconds since the epoch. Returns the number of rows.
+ */
+inline size_t convertReportToBinary(std::string_view csv, std::ostream& out){
+    writeBinaryHeader(out, kBinaryReportMagic, sizeof(BinaryReport));
+    OrderReader reader(csv, kReportFields);
+    std::string_view row[kReportFields];
+    size_t count = 0;
+    while (reader.next(row)){
+        BinaryReport report = {};
+        std::string_view order_id = row[0];
+        if (order_id.substr(0, 3) == "ord"){
+            order_id.remove_prefix(3);
+        }
+        report.order_no = parseInt(order_id);
+        copyField(report.c_ord_id, row[1]);
+        padField(report.instrument, row[2]);
+        report.side = parseInt(row[3]);
+        for (int status = 0; status < 4; status++){
+            if (row[4] == kExecStatusText[status]){
+                report.exec_s = (uint8_t)status;
+            }
+        }
+        report.exec_qty = parseInt(row[5]);
+        if (!parsePrice(row[6], report.price)){
+            report.price = 0;
+        }
+        for (int bit = 0; bit < (int)(sizeof(kRejectReasonText) / sizeof(kRejectReasonText[0])); bit++){
+            if (row[7].find(kRejectReasonText[bit]) != std::string_view::npos){
+                report.reason |= 1 << bit;
+            }
+        }
+        report.time = parseTime(row[8]);
+        out.write((const char*)&report, sizeof(report));
+        count++;
+    }
+    return count;
+}
+
+/// converts a binary execution report into the CSV layout written by ReportWriter. Returns the number of rows
+inline size_t convertReportToCsv(std::string_view binary, std::ostream& out){
+    SymbolTable symbols = instrumentSymbols();
+    ReportWriter writer(out, symbols);
+    writer.writeHeader();
+    std::string_view records = binaryRecords(binary, kBinaryReportMagic, sizeof(BinaryReport));
+    size_t count = records.size() / sizeof(BinaryReport);
+    for (size_t i = 0; i < count; i++){
+        BinaryReport row;
+        std::memcpy(&row, records.data() + i * sizeof(BinaryReport), sizeof(row));
+        exec_rep rep;
+        rep.price = row.price;
+        rep.order_no = row.order_no;
+        rep.side = row.side;
+        rep.exec_qty = row.exec_qty;
+        rep.inst_id = symbols.intern(fieldText(row.instrument));
+        copyField(rep.c_ord_id, fieldText(row.c_ord_id));
+        rep.exec_s = (ExecStatus)(row.exec_s & 3);
+        rep.reason = row.reason;
+        writer.write(rep, row.time);
+    }
+    return count;
+}
+
+/**
+ * checks if the input order is valid
+ * if invalid rejects the order and updates the reason
+*/
+inline bool checkValid(in_ord* order){
+    if (!isTraded(order->inst_id)){ // check if the instrument is valid
+        order->reason |= kInvalidInstrument; // update the reason of the order
+    }
+    if (order->side != 1 && order->side != 2){ // check if the side is valid
+        order->reason |= kInvalidSide;
+    }
+    if (order->price <= 0 || (isTraded(order->inst_id) && order->price % instruments[order->inst_id].tick_size != 0)){ // check if the price is valid and on the tick size of the instrument
+        order->reason |= kInvalidPrice;
+    }
+    if (order->qty % 10 != 0 || order->qty == 0 || order->qty > 1000){ // check if the quantity is valid
+        order->reason |= kInvalidSize;
+    }
+    if (order->reason != 0){
+        order->exec_s = ExecStatus::Reject; // update the execution status of the order as Reject
+        order->exec_qty = order->qty; // update the execution quantity of the order
+        return false;
+    }
+    return true;
+
+}
+
+/// source of the orders of another source that appends every valid order to the journal before handing it out
+template <class Source>
+class JournaledSource {
+public:
+    JournaledSource(Source& orders, Journal& journal) : orders(orders), journal(journal) {}
+
+    bool next(in_ord* order){
+        if (!orders.next(order)){
+            return false;
+        }
+        in_ord checked = *order; // validated on a copy, the engine validates the order itself
+        if (checkValid(&checked)){
+            journal.append(order);
+        }
+        return true;
+    }
+
+    int nextOrderNo() const { return orders.nextOrderNo(); }
+
+private:
+    Source& orders;
+    Journal& journal;
+};
+
+/**
+ * FIFO price levels of one side of an order book, kept in a map ordered best price first.
+ *
+ * Better is the ordering of the side: std::greater for the buy side (highest price first) and std::less for the
+ * sell side (lowest price first). Any price can rest in the map.
+ *
+ */
+template <class Better>
+class MapSide {
+public:
+    explicit MapSide(const InstrumentSpec&) {}
+
+    bool better(Price a, Price b) const { return Better()(a, b); } // checks if price a is better than price b on this side
+    bool accepts(Price) const { return true; }
+    bool empty() const { return levels.empty(); }
+    Price bestPrice() const { return levels.begin()->first; }
+    PriceLevel& best() { return levels.begin()->second; }
+    void dropBest() { levels.erase(levels.begin()); } // removes the best level once its last order is gone
+    PriceLevel& level(Price price) { return levels[price]; } // returns the level of the price, creating it if needed
+
+    // calls f(price, level) for every level, best price first
+    template <class F>
+    void forEachLevel(F f) {
+        for (auto& level : levels){
+            f(level.first, level.second);
+        }
+    }
+
+private:
+    std::map<Price, PriceLevel, Better> levels;
+};
+
+// index of the lowest set bit of a non-zero word
+inline int lowestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (int)index;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+// index of the highest set bit of a non-zero word
+inline int highestBit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, word);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+/**
+ * FIFO price levels of one side of an order book, kept in a flat array with one level per tick of the price band
+ * of the instrument (InstrumentSpec::band_low to band_high).
+ *
+ * A bitmap marks the levels that hold orders and best_index points at the best one, so resting an order is a direct
+ * array access and the next best level is found with a few bit scans when the best one empties. Prices outside the
+ * band are not accepted by this side.
+ *
+ */
+template <bool Buy>
+class LadderSide {
+public:
+    explicit LadderSide(const InstrumentSpec& spec)
+        : tick_size(spec.tick_size), band_low(spec.band_low), band_high(spec.band_high),
+          levels((spec.band_high - spec.band_low) / spec.tick_size + 1), bitmap((levels.size() + 63) / 64) {}
+
+    bool better(Price a, Price b) const { return Buy ? a > b : a < b; } // checks if price a is better than price b on this side
+    bool accepts(Price price) const { return price >= band_low && price <= band_high; }
+    bool empty() const { return best_index < 0; }
+    Price bestPrice() const { return band_low + best_index * tick_size; }
+    PriceLevel& best() { return levels[best_index]; }
+
+    // removes the best level once its last order is gone and moves to the next level holding orders
+    void dropBest() {
+        bitmap[best_index / 64] &= ~(uint64_t(1) << (best_index % 64));
+        best_index = Buy ? previousLevel(best_index) : nextLevel(best_index);
+    }
+
+    // returns the level of the price, marking it as holding orders
+    PriceLevel& level(Price price) {
+        long index = long((price - band_low) / tick_size);
+        bitmap[index / 64] |= uint64_t(1) << (index % 64);
+        if (best_index < 0 || (Buy ? index > best_index : index < best_index)){
+            best_index = index;
+        }
+        return levels[index];
+    }
+
+    // calls f(price, level) for every level holding orders, best price first
+    template <class F>
+    void forEachLevel(F f) {
+        for (long i = best_index; i >= 0; i = Buy ? previousLevel(i) : nextLevel(i)){
+            f(band_low + i * tick_size, levels[i]);
+        }
+    }
+
+private:
+    // index of the first level above the given index that holds orders, or -1
+    long nextLevel(long index) const {
+        long word = (index + 1) / 64;
+        if (word >= (long)bitmap.size()){
+            return -1;
+        }
+        uint64_t bits = bitmap[word] & (~uint64_t(0) << ((index + 1) % 64));
+        while (bits == 0){
+            if (++word == (long)bitmap.size()){
+                return -1;
+            }
+            bits = bitmap[word];
+        }
+        return word * 64 + lowestBit(bits);
+    }
+
+    // index of the first level below the given index that holds orders, or -1
+    long previousLevel(long index) const {
+        if (index == 0){
+            return -1;
+        }
+        long word = (index - 1) / 64;
+        uint64_t bits = bitmap[word] & (~uint64_t(0) >> (63 - (index - 1) % 64));
+        while (bits == 0){
+            if (--word < 0){
+                return -1;
+            }
+            bits = bitmap[word];
+        }
+        return word * 64 + highestBit(bits);
+    }
+
+    Price tick_size, band_low, band_high;
+    std::vector<PriceLevel> levels;
+    std::vector<uint64_t> bitmap;
+    long best_index = -1;
+};
+
+/**
+ * Order book of a single instrument.
+ *
+ * blue_levels holds the buy orders and pink_levels holds the sell orders, each as price levels ordered best price
+ * first (see MapSide and LadderSide). Orders with the same price are queued in time priority in their level.
+ *
+ */
+template <class Bids, class Asks>
+class OrderBook {
+public:
+    OrderBook(const InstrumentSpec& spec, OrderPool& pool) : blue_levels(spec), pink_levels(spec), pool(pool) {}
+    OrderBook(const OrderBook&) = delete;
+    OrderBook& operator=(const OrderBook&) = delete;
+    ~OrderBook();
+
+    template <class Report>
+    void match(in_ord* order, Report& report);
+
+    // queues a resting order taken from a snapshot at the back of its price level, without matching it. Returns false
+    // if its price cannot rest in this book
+    bool restore(in_ord* order){
+        if (!blue_levels.accepts(order->price)){
+            return false;
+        }
+        if (order->side == 1){
+            blue_levels.level(order->price).push_back(order);
+        }
+        else{
+            pink_levels.level(order->price).push_back(order);
+        }
+        return true;
+    }
+
+    // calls f(order) for every resting order: the buy side then the sell side, best price first and in time priority
+    template <class F>
+    void forEachOrder(F f){
+        auto visit = [&f](Price, PriceLevel& level){
+            for (in_ord* order = level.front(); order != nullptr; order = order->next){
+                f(order);
+            }
+        };
+        blue_levels.forEachLevel(visit);
+        pink_levels.forEachLevel(visit);
+    }
+
+private:
+    template <class Side, class Report>
+    void matchAgainst(in_ord* order, Side& opposite, Report& report);
+
+    Bids blue_levels;
+    Asks pink_levels;
+    OrderPool& pool; // the pool the orders of the book are allocated from
+};
+
+using MapOrderBook = OrderBook<MapSide<std::greater<Price>>, MapSide<std::less<Price>>>;
+using LadderOrderBook = OrderBook<LadderSide<true>, LadderSide<false>>;
+
+// releases the orders still resting in the book
+template <class Bids, class Asks>
+OrderBook<Bids, Asks>::~OrderBook(){
+    auto release = [this](Price, PriceLevel& level){
+        while (!level.empty()){
+            in_ord* order = level.front();
+            level.pop_front();
+            pool.release(order);
+        }
+    };
+    blue_levels.forEachLevel(release);
+    pink_levels.forEachLevel(release);
+}
+
+/**
+ * Executes a valid order against the opposite side of the book and writes the execution reports.
+ * Report is the destination of the reports: the ReportWriter, or the queue of a matching thread (see QueuedReports).
+ *
+ * A buy order matches the sell orders while its price is greater than or equal to the best sell price, and a sell
+ * order matches the buy orders while its price is less than or equal to the best buy price. Trades are reported at
+ * the price of the resting order. If the order does not cross the book it is reported as New, and whatever quantity
+ * is left after matching is queued at the back of its price level.
+ *
+ */
+template <class Bids, class Asks>
+template <class Report>
+void OrderBook<Bids, Asks>::match(in_ord* order, Report& report){
+    if (!blue_levels.accepts(order->price)){ // the price cannot rest in this book
+        order->reason |= kPriceOutOfBand;
+        order->exec_s = ExecStatus::Reject;
+        order->exec_qty = order->qty;
+        report.writeOrder(order, order->price);
+        pool.release(order);
+        return;
+    }
+
+    if (order->side == 1){
+        matchAgainst(order, pink_levels, report);
+    }
+    else{
+        matchAgainst(order, blue_levels, report);
+    }
+
+    if (order->qty > 0){ // the remaining quantity rests in the book
+        if (order->side == 1){
+            blue_levels.level(order->price).push_back(order);
+        }
+        else{
+            pink_levels.level(order->price).push_back(order);
+        }
+    }
+    else{
+        pool.release(order); // release the incoming order slot since it is filled
+    }
+}
+
+// matches the order with the given opposite side of the book, best price level first
+template <class Bids, class Asks>
+template <class Side, class Report>
+void OrderBook<Bids, Asks>::matchAgainst(in_ord* order, Side& opposite, Report& report){
+    // the order can trade with the best level unless its price is worse than the level price
+    auto crosses = [&](){
+        return !opposite.empty() && !opposite.better(order->price, opposite.bestPrice());
+    };
+
+    if (!crosses()){ // the order does not match anything. This means it is should be a new order.
+        order->exec_s = ExecStatus::New; // update the execution status of the order as New
+        order->exec_qty = order->qty; // update the execution quantity of the order
+        order->reason = 0; // update the reason of the order as empty
+        report.writeOrder(order, order->price); // write the order to the execution report using its own price
+        return;
+    }
+
+    while (order->qty > 0 && crosses()){ // do while the quantity of the order becomes zero.
+        PriceLevel& level = opposite.best();
+        in_ord* resting = level.front(); // the oldest order at the best price
+        if (order->qty >= resting->qty){ // do the following if the resting order is filled
+            order->exec_s = order->qty == resting->qty ? ExecStatus::Fill : ExecStatus::Pfill; // the incoming order is filled only if both quantities are equal
+            order->exec_qty = resting->qty; // update the execution quantity of the incoming order
+            order->qty -= order->exec_qty; // update the quantity of the incoming order
+            report.writeOrder(order, resting->price); // write the order to the execution report. Important thing is to use the price of the resting order
+
+            resting->exec_s = ExecStatus::Fill; // do the same for the resting order
+            resting->exec_qty = resting->qty;
+            report.writeOrder(resting, resting->price);
+
+            level.pop_front(); // remove the resting order from its level
+            pool.release(resting); // release the resting order slot since it is filled
+            if (level.empty()){
+                opposite.dropBest(); // drop the level once its last order is gone
+            }
+        }
+        else{ // do the following if the quantity of the incoming order is less than the quantity of the resting order
+            order->exec_s = ExecStatus::Fill; // update the execution status of the incoming order as Fill
+            order->exec_qty = order->qty; // update the execution quantity of the incoming order
+            order->qty = 0; // the incoming order is filled
+            report.writeOrder(order, resting->price); // write the order to the execution report. Important thing is to use the price of the resting order
+
+            resting->exec_s = ExecStatus::Pfill; // update the execution status of the resting order as Pfill
+            resting->exec_qty = order->exec_qty; // update the execution quantity of the resting order
+            resting->qty -= resting->exec_qty; // update the quantity of the resting order
+            report.writeOrder(resting, resting->price);
+        }
+    }
+}
+
+/// creates the order books of all the instruments, indexed by the instrument ID, allocating from the given pool
+template <class Book>
+std::vector<std::unique_ptr<Book>> makeBooks(OrderPool& pool){
+    std::vector<std::unique_ptr<Book>> books;
+    for (const InstrumentSpec& spec : instruments){
+        books.emplace_back(new Book(spec, pool));
+    }
+    return books;
+}
+
+/// checks if the order is valid and executes it in the order book of its instrument, or reports it as rejected
+template <class Book, class Report>
+void executeOrder(in_ord* order, std::vector<std::unique_ptr<Book>>& books, OrderPool& pool, Report& report){
+    if (!checkValid(order)){
+        report.writeOrder(order, order->price);
+        pool.release(order);
+    }
+    else{
+        books[order->inst_id]->match(order, report);
+    }
+}
+
+/**
+ * State of the books carried from one run of the engine to the next: the resting orders of every book, each book's
+ * buy side then sell side, best price first and in time priority, and the number of the next order.
+ *
+ * A run restores the books from the snapshot before its first order and saves them back into it after its last
+ * one. writeSnapshot and readSnapshot store it in a binary file, so a restarted process starts with the books it
+ * had instead of replaying every earlier order.
+ *
+ */
+struct Snapshot {
+    int next_order_no = 1;
+    std::vector<in_ord> orders;
+};
+
+/**
+ * Snapshot file: a SnapshotHeader followed by one SnapshotOrder per resting order. Orders refer to their instrument by
+ * name, so a snapshot stays valid when the list of instruments changes.
+ */
+const char kSnapshotMagic[8] = {'F', 'X', 'S', 'N', 'A', 'P', 'S', 'H'};
+
+struct SnapshotHeader {
+    BinaryFileHeader file;
+    int64_t next_order_no;
+    uint64_t orders;
+};
+
+struct SnapshotOrder {
+    Price price;
+    int32_t order_no, side, qty, reserved;
+    char c_ord_id[16];
+    char instrument[16];
+};
+
+static_assert(sizeof(SnapshotHeader) == 32 && sizeof(SnapshotOrder) == 56, "the snapshot records must keep their layout");
+
+/// writes the snapshot as a snapshot file
+inline void writeSnapshot(const Snapshot& snapshot, std::ostream& out){
+    SnapshotHeader header = {};
+    std::memcpy(header.file.magic, kSnapshotMagic, sizeof(header.file.magic));
+    header.file.record_size = sizeof(SnapshotOrder);
+    header.next_order_no = snapshot.next_order_no;
+    header.orders = snapshot.orders.size();
+    out.write((const char*)&header, sizeof(header));
+
+    std::vector<SnapshotOrder> rows(snapshot.orders.size());
+    for (size_t i = 0; i < rows.size(); i++){
+        const in_ord& order = snapshot.orders[i];
+        SnapshotOrder& row = rows[i];
+        std::memset(&row, 0, sizeof(row));
+        row.price = order.price;
+        row.order_no = order.order_no;
+        row.side = order.side;
+        row.qty = order.qty;
+        std::memcpy(row.c_ord_id, order.c_ord_id, sizeof(row.c_ord_id));
+        padField(row.instrument, isTraded(order.inst_id) ? std::string_view(instruments[order.inst_id].name) : std::string_view());
+    }
+    out.write((const char*)rows.data(), rows.size() * sizeof(SnapshotOrder));
+}
+
+/**
+ * Reads the contents of a snapshot file. Orders of instruments that are no longer traded are dropped and counted in
+ * dropped. Returns false if the contents are not a complete snapshot of this version.
+ */
+inline bool readSnapshot(std::string_view contents, Snapshot& snapshot, size_t& dropped){
+    SnapshotHeader header;
+    if (!isBinaryFile(contents, kSnapshotMagic) || contents.size() < sizeof(header)){
+        return false;
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (header.file.record_size != sizeof(SnapshotOrder) || contents.size() != sizeof(header) + header.orders * sizeof(SnapshotOrder)){
+        return false;
+    }
+
+    SymbolTable symbols = instrumentSymbols();
+    snapshot.next_order_no = (int)header.next_order_no;
+    snapshot.orders.clear();
+    snapshot.orders.reserve(header.orders);
+    dropped = 0;
+    for (size_t i = 0; i < header.orders; i++){
+        SnapshotOrder row;
+        std::memcpy(&row, contents.data() + sizeof(header) + i * sizeof(row), sizeof(row));
+        int inst_id = symbols.find(fieldText(row.instrument));
+        if (!isTraded(inst_id) || (row.side != 1 && row.side != 2)){
+            dropped++;
+            continue;
+        }
+        in_ord order;
+        std::memset(&order, 0, sizeof(order));
+        order.price = row.price;
+        order.order_no = row.order_no;
+        order.side = row.side;
+        order.qty = row.qty;
+        copyField(order.c_ord_id, fieldText(row.c_ord_id));
+        order.inst_id = inst_id;
+        order.exec_s = ExecStatus::New;
+        snapshot.orders.push_back(order);
+    }
+    return true;
+}
+
+/**
+ * Rests the orders of the snapshot in the books, in snapshot order so that every level keeps its time priority.
+ * Orders whose instrument has no book here (a null book belongs to another shard) are left to the other books.
+ * Orders whose price cannot rest in their book are dropped and counted in the statistics.
+ */
+template <class Book>
+void restoreBooks(const Snapshot& snapshot, std::vector<std::unique_ptr<Book>>& books, OrderPool& pool, std::ostream& stats){
+    size_t dropped = 0;
+    for (const in_ord& resting : snapshot.orders){
+        if (books[resting.inst_id] == nullptr){
+            continue;
+        }
+        in_ord* order = pool.allocate();
+        *order = resting;
+        order->next = nullptr;
+        if (!books[resting.inst_id]->restore(order)){
+            pool.release(order);
+            dropped++;
+        }
+    }
+    if (dropped > 0){
+        stats << "Dropped " << dropped << " orders of the snapshot whose price cannot rest in the book\n";
+    }
+}
+
+/// appends the resting orders of the book to the snapshot
+template <class Book>
+void saveBook(Book& book, Snapshot& snapshot){
+    book.forEachOrder([&snapshot](const in_ord* order){
+        snapshot.orders.push_back(*order);
+        snapshot.orders.back().next = nullptr;
+    });
+}
+
+/**
+ * Reads the orders from the source (CsvOrderSource or BinaryOrderSource), executes them in the books of the given
+ * type and writes the execution report. Every order is created straight from its row or record.
+ */
+template <class Book, class Source>
+void processOrders(Source& orders, ReportWriter& report, std::ostream& stats, Snapshot& state){
+    // pool of the order slots. It is declared before the books so that it outlives them
+    OrderPool pool;
+
+    //order books initialization, one for each instrument and indexed by the instrument ID
+    std::vector<std::unique_ptr<Book>> books = makeBooks<Book>(pool);
+    restoreBooks(state, books, pool, stats); // rest the orders left by the previous run
+
+    report.writeHeader(); // write the name of the output file and the header column names
+
+    // Execute a loop until the end of the file
+    in_ord* order = pool.allocate();
+    while (orders.next(order)) { // create the order struct using the next row of the input
+        executeOrder(order, books, pool, report); // check if the order is valid and execute it
+        order = pool.allocate();
+    }
+    pool.release(order); // the slot of the row after the last one
+
+    // keep the resting orders for the next run
+    state.next_order_no = orders.nextOrderNo();
+    state.orders.clear();
+    for (auto& book : books){
+        saveBook(*book, state);
+    }
+
+    pool.printStats(stats); // report the allocator statistics at shutdown
+}
+
+/**
+ * Bounded lock-free queue between one producer thread and one consumer thread.
+ *
+ * The capacity is rounded up to a power of two. head is only written by the consumer and tail only by the producer,
+ * each on its own cache line, and each side keeps a cached copy of the other index so that it only reads the shared
+ * one when the queue looks full or empty. push and pop yield the thread while they wait.
+ *
+ * Each side also counts how often it had to wait, and the producer keeps the highest queue depth it has seen, so a
+ * pipeline can tell which of its stages limits the throughput. The counters are read once both threads are joined.
+ *
+ */
+template <class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity){
+        size_t size = 2;
+        while (size < capacity){
+            size *= 2;
+        }
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool tryPush(const T& item){
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_cache > mask){
+            head_cache = head.load(std::memory_order_acquire);
+            if (t - head_cache > mask){
+                return false;
+            }
+        }
+        slots[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        pushes++;
+        if (t + 1 - head_cache > max_depth){
+            max_depth = t + 1 - head_cache;
+        }
+        return true;
+    }
+
+    bool tryPop(T& item){
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_cache){
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h == tail_cache){
+                return false;
+            }
+        }
+        item = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(const T& item){
+        if (tryPush(item)){
+            return;
+        }
+        full_waits++; // the consumer is behind
+        do {
+            std::this_thread::yield();
+        } while (!tryPush(item));
+    }
+
+    void pop(T& item){
+        if (tryPop(item)){
+            return;
+        }
+        empty_waits++; // the producer is behind
+        do {
+            std::this_thread::yield();
+        } while (!tryPop(item));
+    }
+
+    // writes the queue statistics
+    void printStats(std::ostream& out, const char* name) const {
+        out << name << " queue: " << pushes << " messages, max depth " << max_depth << " of " << slots.size()
+            << ", producer waited " << full_waits << " times, consumer waited " << empty_waits << " times\n";
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0}; // next slot to pop
+    size_t tail_cache = 0; // consumer copy of tail
+    size_t empty_waits = 0; // number of pops that waited for an item
+    alignas(64) std::atomic<size_t> tail{0}; // next slot to push
+    size_t head_cache = 0; // producer copy of head
+    size_t pushes = 0, max_depth = 0;
+    size_t full_waits = 0; // number of pushes that waited for a free slot
+};
+
+// message from the parser to a matching thread: an order, which may already be rejected, or the end of the orders
+struct OrderMessage {
+    in_ord order;
+    bool stop;
+};
+
+// message from a matching thread to the report writer: a report, the end of the reports of one order, or the end of
+// all the reports of the matching thread
+struct ReportMessage {
+    enum Kind : uint8_t { kReport, kEndOfOrder, kEndOfStream };
+    exec_rep report;
+    Kind kind;
+};
+
+// report destination of a matching thread: hands every report to the report writer
+struct QueuedReports {
+    SpscRing<ReportMessage>& output;
+
+    void writeOrder(const in_ord* order, Price price){
+        output.push({makeExecRep(order, price), ReportMessage::kReport});
+    }
+};
+
+/**
+ * Matching thread, owning the books of the instruments whose ID modulo the number of shards is its index.
+ *
+ * It takes the orders from its input queue, copies the valid ones into its own order pool and matches them, and
+ * pushes their reports to its output queue. Orders rejected by the parser are only reported. With mark_orders set,
+ * the reports of every order are followed by an end of order message. The matching thread never touches a file or
+ * formats text.
+ *
+ */
+template <class Book>
+class MatchingShard {
+public:
+    MatchingShard(int index, int shards, size_t queue_size, bool mark_orders)
+        : input(queue_size), output(queue_size), mark_orders(mark_orders) {
+        for (int i = 0; i < (int)instruments.size(); i++){
+            books.emplace_back(i % shards == index ? new Book(instruments[i], pool) : nullptr);
+        }
+    }
+
+    void run(){
+        QueuedReports reports{output};
+        OrderMessage message;
+        for (input.pop(message); !message.stop; input.pop(message)){
+            if (message.order.exec_s == ExecStatus::Reject){
+                reports.writeOrder(&message.order, message.order.price);
+            }
+            else{
+                in_ord* order = pool.allocate();
+                *order = message.order;
+                books[order->inst_id]->match(order, reports);
+            }
+            if (mark_orders){
+                output.push({exec_rep(), ReportMessage::kEndOfOrder});
+            }
+        }
+        output.push({exec_rep(), ReportMessage::kEndOfStream});
+    }
+
+    SpscRing<OrderMessage> input;
+    SpscRing<ReportMessage> output;
+    bool mark_orders;
+    OrderPool pool; // declared before the books so that it outlives them
+    std::vector<std::unique_ptr<Book>> books;
+};
+
+/**
+ * Reads and validates the orders on the calling thread and matches them on one thread per shard, each shard owning
+ * the books of a subset of the instruments.
+ *
+ * A merge thread writes the execution report. The parser tells it the shard of each order in input order, and the
+ * merge thread takes that shard's reports up to its end of order message. Rejected orders are passed through the
+ * first shard. The rows are therefore written in exactly the same order as processOrders writes them.
+ *
+ */
+template <class Book, class Source>
+void processOrdersSharded(Source& orders, ReportWriter& report, std::ostream& stats, Snapshot& state, int shards, size_t queue_size){
+    std::vector<std::unique_ptr<MatchingShard<Book>>> matching;
+    for (int i = 0; i < shards; i++){
+        matching.emplace_back(new MatchingShard<Book>(i, shards, queue_size, true));
+        restoreBooks(state, matching[i]->books, matching[i]->pool, stats); // each shard rests the orders of its books
+    }
+    SpscRing<int> routes(queue_size); // shard of each order, -1 at the end of the orders
+
+    std::vector<std::thread> threads;
+    for (auto& shard : matching){
+        threads.emplace_back([&shard](){ shard->run(); });
+    }
+    threads.emplace_back([&](){
+        report.writeHeader(); // write the name of the output file and the header column names
+        int shard;
+        ReportMessage message;
+        for (routes.pop(shard); shard >= 0; routes.pop(shard)){
+            SpscRing<ReportMessage>& reports = matching[shard]->output;
+            for (reports.pop(message); message.kind == ReportMessage::kReport; reports.pop(message)){
+                report.write(message.report);
+            }
+        }
+    });
+
+    OrderMessage message;
+    message.stop = false;
+    while (orders.next(&message.order)) { // create the order struct using the next row of the input
+        // valid orders are routed to the shard owning the book of their instrument
+        int shard = checkValid(&message.order) ? message.order.inst_id % shards : 0;
+        matching[shard]->input.push(message);
+        routes.push(shard);
+    }
+
+    message.stop = true;
+    for (auto& shard : matching){
+        shard->input.push(message);
+    }
+    routes.push(-1);
+    for (std::thread& thread : threads){
+        thread.join();
+    }
+
+    // keep the resting orders for the next run, in instrument order like processOrders
+    state.next_order_no = orders.nextOrderNo();
+    state.orders.clear();
+    for (int i = 0; i < (int)instruments.size(); i++){
+        saveBook(*matching[i % shards]->books[i], state);
+    }
+
+    for (int i = 0; i < shards; i++){ // report the allocator statistics at shutdown
+        stats << "Shard " << i << ": ";
+        matching[i]->pool.printStats(stats);
+    }
+}
+
+/**
+ * Runs the orders through a pipeline of three threads: the calling thread reads and validates the orders, a matching
+ * thread executes them in the books, and a writer thread formats and writes the execution report. The stages are
+ * connected by SpscRing queues of fixed size order and report records.
+ *
+ * At the end the statistics of both queues are printed: a producer that often waits means the next stage is the
+ * bottleneck, and a consumer that often waits means the previous one is.
+ *
+ */
+template <class Book, class Source>
+void processOrdersPipelined(Source& orders, ReportWriter& report, std::ostream& stats, Snapshot& state, size_t queue_size){
+    MatchingShard<Book> matcher(0, 1, queue_size, false);
+    restoreBooks(state, matcher.books, matcher.pool, stats); // rest the orders left by the previous run
+    std::thread matching([&](){ matcher.run(); });
+    std::thread writing([&](){
+        report.writeHeader(); // write the name of the output file and the header column names
+        ReportMessage message;
+        for (matcher.output.pop(message); message.kind != ReportMessage::kEndOfStream; matcher.output.pop(message)){
+            report.write(message.report);
+        }
+    });
+
+    OrderMessage message;
+    message.stop = false;
+    while (orders.next(&message.order)) { // create the order struct using the next row of the input
+        checkValid(&message.order); // rejected orders are only reported by the matching thread
+        matcher.input.push(message);
+    }
+
+    message.stop = true;
+    matcher.input.push(message);
+    matching.join();
+    writing.join();
+
+    // keep the resting orders for the next run
+    state.next_order_no = orders.nextOrderNo();
+    state.orders.clear();
+    for (auto& book : matcher.books){
+        saveBook(*book, state);
+    }
+
+    matcher.input.printStats(stats, "Parse -> match");
+    matcher.output.printStats(stats, "Match -> write");
+    matcher.pool.printStats(stats); // report the allocator statistics at shutdown
+}
+
+/**
+ * Options of the matching engine.
+ *
+ * mode: kSingle matches on the calling thread (processOrders), kSharded on one thread per shard
+ *       (processOrdersSharded) and kPipeline on a parse -> match -> write pipeline (processOrdersPipelined).
+ * ladder_book: Use the price ladder books, which only accept prices inside the band of each instrument.
+ * shards: The number of matching threads of the sharded mode.
+ * queue_size: The capacity of the queues between the threads.
+ * buffer_size: The size of the buffer of the report writer.
+ * report_format: The layout of the execution report, CSV text or binary records.
+ *
+ */
+struct EngineOptions {
+    enum Mode { kSingle, kSharded, kPipeline };
+    Mode mode = kSingle;
+    bool ladder_book = false;
+    int shards = (int)instruments.size();
+    size_t queue_size = 4096;
+    size_t buffer_size = 1 << 20;
+    ReportFormat report_format = ReportFormat::Csv;
+};
+
+/// runs the orders of the source through the engine mode of the options, journaling them first if a journal is given
+template <class Book, class Source>
+void runOrders(Source& orders, ReportWriter& report, const EngineOptions& options, std::ostream& stats, Snapshot& state, Journal* journal){
+    if (journal != nullptr){
+        JournaledSource<Source> journaled(orders, *journal);
+        report.setJournal(journal);
+        runOrders<Book>(journaled, report, options, stats, state, nullptr);
+        report.flush(); // commits the last group of the journal before the rows it covers
+        report.setJournal(nullptr);
+        return;
+    }
+    switch (options.mode){
+        case EngineOptions::kSingle:
+        processOrders<Book>(orders, report, stats, state);
+        break;
+
+        case EngineOptions::kSharded:
+        processOrdersSharded<Book>(orders, report, stats, state, options.shards, options.queue_size);
+        break;
+
+        case EngineOptions::kPipeline:
+        processOrdersPipelined<Book>(orders, report, stats, state, options.queue_size);
+        break;
+    }
+}
+
+/**
+ * Runs the orders of the input through an engine with the given options and writes the execution report to out.
+ * The books start from the state, whose orders are numbered from its next order number, and are saved back into it
+ * at the end. Every valid order is appended to the journal, if one is given, before it is matched.
+ *
+ * The input is read as a binary order file or a journal if it starts with their header, and as a CSV order file
+ * otherwise. Replaying a journal rebuilds the books it was written from. Returns false if the input is a binary file
+ * of another version.
+ */
+template <class Book>
+bool runEngine(std::string_view input, std::ostream& out, const EngineOptions& options, std::ostream& stats, Snapshot& state,
+               Journal* journal = nullptr){
+    SymbolTable symbols = instrumentSymbols(); // instrument names interned into instrument IDs
+    ReportWriter report(out, symbols, options.buffer_size, options.report_format); // writer of the execution report
+
+    if (isBinaryFile(input, kBinaryOrderMagic)){
+        BinaryOrderSource orders(input, symbols, state.next_order_no);
+        if (!orders.valid()){
+            stats << "Unsupported binary order file\n";
+            return false;
+        }
+        runOrders<Book>(orders, report, options, stats, state, journal);
+    }
+    else if (isBinaryFile(input, kJournalMagic)){
+        JournalOrderSource orders(input, symbols, state.next_order_no);
+        if (!orders.valid()){
+            stats << "Unsupported journal file\n";
+            return false;
+        }
+        runOrders<Book>(orders, report, options, stats, state, journal);
+    }
+    else{
+        CsvOrderSource orders(input, symbols, state.next_order_no);
+        runOrders<Book>(orders, report, options, stats, state, journal);
+    }
+    return true;
+}
+
+/// runs the orders of the input through a new engine with empty books (see above)
+template <class Book>
+bool runEngine(std::string_view input, std::ostream& out, const EngineOptions& options, std::ostream& stats){
+    Snapshot state;
+    return runEngine<Book>(input, out, options, stats, state);
+}
+
+#endif // EXCHANGE_ENGINE_H